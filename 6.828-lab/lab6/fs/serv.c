@@ -6,6 +6,8 @@
 #include <inc/x86.h>
 #include <inc/string.h>
 
+#include <arch/thread.h>
+
 #include "fs.h"
 
 
@@ -28,59 +30,159 @@
 //    communicate with the server.  File IDs are a lot like
 //    environment IDs in the kernel.  Use openfile_lookup to translate
 //    file IDs to struct OpenFile.
+//
+// Unused OpenFiles are kept on a free list, so opening a file does not
+// have to search the table.  A file is closed when its clients unmap
+// the Fd page, which the server cannot observe directly.  Entries whose
+// Fd page only the server still maps are returned to the free list by
+// openfile_reclaim.  Whenever openfile_alloc would hand out an entry
+// whose Fd page has never been allocated, it first checks the next
+// RECLAIM_BATCH entries in use, going round the table, so closed
+// entries are mostly reused before fresh ones at a bounded cost per
+// open.  Only when the free list runs dry does it sweep them all.
 
 struct OpenFile {
 	uint32_t o_fileid;	// file id
 	struct File *o_file;	// mapped descriptor for open file
 	int o_mode;		// open mode
 	struct Fd *o_fd;	// Fd page
+	struct OpenFile *o_free_link;	// next OpenFile on the free list
 };
 
-// Max number of open files in the file system at once
-#define MAXOPEN		1024
+// Max number of open files in the file system at once.
+// Must be a power of two; see FILEID_INDEX.
+#define MAXOPEN		8192
 #define FILEVA		0xD0000000
 
+// A file ID holds the opentab index of its OpenFile in the low bits and
+// a generation number, bumped each time the entry is reused, above them.
+// A stale file ID therefore never names a later open of the same entry.
+#define FILEID_INDEX(fileid)	((fileid) & (MAXOPEN - 1))
+#define FILEID_NEXTGEN(fileid)	(((fileid) + MAXOPEN) & 0x7FFFFFFF)
+
 // initialize to force into data section
 struct OpenFile opentab[MAXOPEN] = {
 	{ 0, 0, 1, 0 }
 };
 
-// Virtual address at which to receive page mappings containing client requests.
-union Fsipc *fsreq = (union Fsipc *)0x0ffff000;
+static struct OpenFile *openfile_free_list;
+// Entries below this index have had their Fd page allocated.  Fresh
+// entries leave the free list in index order, so none above it has.
+static int openfile_npages;
+
+// Entries checked for closed files per open that would use a fresh one
+#define RECLAIM_BATCH	8
+// Where the next openfile_reclaim starts
+static int openfile_reclaim_next;
+
+// Each request is served by its own thread (see serve()), so several
+// requests can be in flight at once.  Every in-flight request needs its
+// own argument page; they are received into a pool of QUEUE_SIZE pages
+// just below 0x0ffff000.
+#define QUEUE_SIZE	16
+#define REQVA		(0x0ffff000 - QUEUE_SIZE * PGSIZE)
+
+static bool buse[QUEUE_SIZE];
+
+static union Fsipc *
+get_buffer(void)
+{
+	int i;
+
+	for (i = 0; i < QUEUE_SIZE; i++)
+		if (!buse[i])
+			break;
+	if (i == QUEUE_SIZE)
+		return NULL;
+
+	buse[i] = 1;
+	return (union Fsipc *) (REQVA + i * PGSIZE);
+}
+
+static void
+put_buffer(union Fsipc *fsreq)
+{
+	int i = ((uintptr_t) fsreq - REQVA) / PGSIZE;
+	buse[i] = 0;
+}
 
 void
 serve_init(void)
 {
 	int i;
 	uintptr_t va = FILEVA;
-	for (i = 0; i < MAXOPEN; i++) {
+
+	// Build the free list so that the first open gets entry 0.
+	openfile_free_list = NULL;
+	for (i = MAXOPEN - 1; i >= 0; i--) {
 		opentab[i].o_fileid = i;
-		opentab[i].o_fd = (struct Fd*) va;
-		va += PGSIZE;
+		opentab[i].o_file = NULL;
+		opentab[i].o_fd = (struct Fd*) (va + i * PGSIZE);
+		opentab[i].o_free_link = openfile_free_list;
+		openfile_free_list = &opentab[i];
 	}
 }
 
+// Return an open file to the free list.
+static void
+openfile_free(struct OpenFile *o)
+{
+	o->o_file = NULL;
+	o->o_free_link = openfile_free_list;
+	openfile_free_list = o;
+}
+
+// Check the next 'count' entries that have been used, at most all of
+// them, and move every one that no client holds any more back onto
+// the free list.  Returns the number of entries reclaimed.
+static int
+openfile_reclaim(int count)
+{
+	struct OpenFile *o;
+	int i, n = 0;
+
+	for (i = 0; i < MIN(count, openfile_npages); i++) {
+		if (openfile_reclaim_next >= openfile_npages)
+			openfile_reclaim_next = 0;
+		o = &opentab[openfile_reclaim_next++];
+		if (o->o_file && pageref(o->o_fd) <= 1) {
+			openfile_free(o);
+			n++;
+		}
+	}
+	return n;
+}
+
 // Allocate an open file.
 int
 openfile_alloc(struct OpenFile **o)
 {
-	int i, r;
-
-	// Find an available open-file table entry
-	for (i = 0; i < MAXOPEN; i++) {
-		switch (pageref(opentab[i].o_fd)) {
-		case 0:
-			if ((r = sys_page_alloc(0, opentab[i].o_fd, PTE_P|PTE_U|PTE_W)) < 0)
-				return r;
-			/* fall through */
-		case 1:
-			opentab[i].o_fileid += MAXOPEN;
-			*o = &opentab[i];
-			memset(opentab[i].o_fd, 0, PGSIZE);
-			return (*o)->o_fileid;
-		}
+	struct OpenFile *of;
+	int r;
+
+	// Look for closed entries before using one that was never used
+	if (!openfile_free_list)
+		openfile_reclaim(openfile_npages);
+	else if (pageref(openfile_free_list->o_fd) == 0)
+		openfile_reclaim(RECLAIM_BATCH);
+	if (!openfile_free_list)
+		return -E_MAX_OPEN;
+
+	of = openfile_free_list;
+	// The Fd page of an entry that was never used has to be
+	// allocated; a reclaimed entry still has its page.
+	if (pageref(of->o_fd) == 0) {
+		if ((r = sys_page_alloc(0, of->o_fd, PTE_P|PTE_U|PTE_W)) < 0)
+			return r;
+		openfile_npages = MAX(openfile_npages, of - opentab + 1);
 	}
-	return -E_MAX_OPEN;
+	openfile_free_list = of->o_free_link;
+	of->o_free_link = NULL;
+
+	of->o_fileid = FILEID_NEXTGEN(of->o_fileid);
+	memset(of->o_fd, 0, PGSIZE);
+	*o = of;
+	return of->o_fileid;
 }
 
 // Look up an open file for envid.
@@ -89,8 +191,8 @@ openfile_lookup(envid_t envid, uint32_t fileid, struct OpenFile **po)
 {
 	struct OpenFile *o;
 
-	o = &opentab[fileid % MAXOPEN];
-	if (pageref(o->o_fd) <= 1 || o->o_fileid != fileid)
+	o = &opentab[FILEID_INDEX(fileid)];
+	if (o->o_fileid != fileid || !o->o_file || pageref(o->o_fd) <= 1)
 		return -E_INVAL;
 	*po = o;
 	return 0;
@@ -135,14 +237,14 @@ serve_open(envid_t envid, struct Fsreq_open *req, void **pg_store, int *perm_sto
 				goto try_open;
 			if (debug)
 				cprintf("file_create failed: %e", r);
-			return r;
+			goto err;
 		}
 	} else {
 try_open:
 		if ((r = file_open(path, &f)) < 0) {
 			if (debug)
 				cprintf("file_open failed: %e", r);
-			return r;
+			goto err;
 		}
 	}
 
@@ -151,13 +253,13 @@ try_open:
 		if ((r = file_set_size(f, 0)) < 0) {
 			if (debug)
 				cprintf("file_set_size failed: %e", r);
-			return r;
+			goto err;
 		}
 	}
 	if ((r = file_open(path, &f)) < 0) {
 		if (debug)
 			cprintf("file_open failed: %e", r);
-		return r;
+		goto err;
 	}
 
 	// Save the file pointer
@@ -184,6 +286,11 @@ try_open:
 	*perm_store = PTE_P|PTE_U|PTE_W|PTE_SHARE;
 
 	return 0;
+
+err:
+	// Nothing holds the open file yet; put it straight back.
+	openfile_free(o);
+	return r;
 }
 
 // Set the size of req->req_fileid to req->req_size bytes, truncating
@@ -324,6 +431,39 @@ serve_sync(envid_t envid, union Fsipc *req)
 	return 0;
 }
 
+// Map the block cache page holding byte req_offset of an open file
+// into the caller read-only, so that the network server can send file
+// data without it being copied through IPC pages.  Returns the number of file bytes on that
+// page from req_offset on (0 at end of file), or < 0 on error.
+int
+serve_map(envid_t envid, struct Fsreq_map *req, void **pg_store, int *perm_store)
+{
+	struct OpenFile *o;
+	struct File *f;
+	char *blk;
+	int r;
+
+	if (debug)
+		cprintf("serve_map %08x %08x %08x\n", envid, req->req_fileid, req->req_offset);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	f = o->o_file;
+	if (req->req_offset < 0)
+		return -E_INVAL;
+	if (req->req_offset >= f->f_size)
+		return 0;
+	if ((r = file_get_block(f, req->req_offset / BLKSIZE, &blk)) < 0)
+		return r;
+	// The block is only read in from disk when first touched, and an
+	// unmapped page cannot be sent.
+	(void) *(volatile char *) blk;
+
+	*pg_store = blk;
+	*perm_store = PTE_P|PTE_U;
+	return MIN(BLKSIZE - req->req_offset % BLKSIZE, f->f_size - req->req_offset);
+}
+
 //定义了一个名字叫做fshandler的结构体指针,返回值为int,参数为envid 以及一个 union Fsipc
 typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 
@@ -335,8 +475,9 @@ handlers中的每个函数有不一样的参数,union Fsipc的作用就是可以
 参数传入.
 */
 fshandler handlers[] = {
-	// Open is handled specially because it passes pages
+	// Open and map are handled specially because they pass pages
 	/* [FSREQ_OPEN] =	(fshandler)serve_open, */
+	/* [FSREQ_MAP] =	(fshandler)serve_map, */
 	[FSREQ_READ] =		serve_read,
 	[FSREQ_STAT] =		serve_stat,
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
@@ -345,14 +486,77 @@ fshandler handlers[] = {
 	[FSREQ_SYNC] =		serve_sync
 };
 
+struct serve_args {
+	uint32_t req;
+	envid_t whom;
+	int perm;
+	union Fsipc *fsreq;
+};
+
+// Serve a single request received into args->fsreq, reply to the
+// client and release the argument page.  Runs on its own thread.
+static void
+serve_thread(uint32_t a)
+{
+	struct serve_args *args = (struct serve_args *) a;
+	union Fsipc *fsreq = args->fsreq;
+	uint32_t req = args->req & ~IPCREQ_ASYNC;
+	int perm = args->perm;
+	void *pg = NULL;
+	int r;
+
+	if (req == FSREQ_OPEN) {
+		//serve_open的参数有点不一样,所以单独处理
+		//如果成功，serve_open的返回值0，如果没成功，返回值<0
+		r = serve_open(args->whom, (struct Fsreq_open*)fsreq, &pg, &perm);
+	} else if (req == FSREQ_MAP) {
+		r = serve_map(args->whom, &fsreq->map, &pg, &perm);
+	} else if (req < ARRAY_SIZE(handlers) && handlers[req]) {
+		//根据req作为索引来从handerls这个数组中选择对应的handlers
+		r = handlers[req](args->whom, fsreq);
+	} else {
+		cprintf("Invalid request code %d from %08x\n", req, args->whom);
+		r = -E_INVAL;
+	}
+	// An asynchronous client tells its replies apart by the request
+	// page, so hand that back unless the reply carries a page anyway.
+	if ((args->req & IPCREQ_ASYNC) && !pg) {
+		pg = fsreq;
+		perm = PTE_P|PTE_W|PTE_U;
+	}
+	//向发送者发送数据r,表示当前程序已经接受到消息.
+	//在写入或者读取的时候，这个ｒ表示成功写入或者读取的数据字节数
+	ipc_send(args->whom, r, pg, perm);
+
+	//将fsreq所对应的地址取消映射,留给下次使用
+	//在env2envid中,0表示当前进程
+	sys_page_unmap(0, fsreq);
+	put_buffer(fsreq);
+	free(args);
+}
+
 void
 serve(void)
 {
 	uint32_t req, whom;
-	int perm, r;
-	void *pg;
+	int i, perm;
+	union Fsipc *fsreq;
+	struct serve_args *args;
 
 	while (1) {
+		// ipc_recv blocks the entire environment, so first let
+		// every request thread that can make progress do so.  We
+		// limit the number of yields in case there's a rogue thread.
+		for (i = 0; thread_wakeups_pending() && i < 32; ++i)
+			thread_yield();
+
+		// All argument pages are held by in-flight requests; let
+		// them finish before accepting another.
+		if (!(fsreq = get_buffer())) {
+			thread_yield();
+			continue;
+		}
+
 		perm = 0;
 		/*
 			在file.c中的fsipc()函数参数将会做ipc_send()中的参数value传到这里
@@ -370,31 +574,32 @@ serve(void)
 		if (!(perm & PTE_P)) {
 			cprintf("Invalid request from %08x: no argument page\n",
 				whom);
+			put_buffer(fsreq);
 			continue; // just leave it hanging...
 		}
 
-		pg = NULL;
-		if (req == FSREQ_OPEN) {
-			//serve_open的参数有点不一样,所以单独处理
-			//如果成功，serve_open的返回值0，如果没成功，返回值<0
-			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
-		} else if (req < ARRAY_SIZE(handlers) && handlers[req]) {
-			//根据req作为索引来从handerls这个数组中选择对应的handlers
-			r = handlers[req](whom, fsreq);
-		} else {
-			cprintf("Invalid request code %d from %08x\n", req, whom);
-			r = -E_INVAL;
-		}
-		//向发送者发送数据r,表示当前程序已经接受到消息.
-		//在写入或者读取的时候，这个ｒ表示成功写入或者读取的数据字节数
-		ipc_send(whom, r, pg, perm);
-		
-		//将fsreq所对应的地址取消映射,留给下次使用
-		//在env2envid中,0表示当前进程
-		sys_page_unmap(0, fsreq);
+		// Hand the request to its own thread so that a request
+		// which has to wait for the disk does not hold up the ones
+		// that can be answered from the block cache.
+		if (!(args = malloc(sizeof(struct serve_args))))
+			panic("could not allocate serve thread args");
+		args->req = req;
+		args->whom = whom;
+		args->perm = perm;
+		args->fsreq = fsreq;
+
+		if (thread_create(0, "serve_thread", serve_thread, (uint32_t) args) < 0)
+			panic("could not create serve thread");
+		thread_yield(); // let the thread created run
 	}
 }
 
+static void
+tmain(uint32_t arg)
+{
+	serve();
+}
+
 void
 umain(int argc, char **argv)
 {
@@ -408,6 +613,12 @@ umain(int argc, char **argv)
 
 	serve_init();
 	fs_init();
-	serve();
+
+	// Requests are served by user-level threads; start the thread
+	// library and jump into a thread to run the server loop.
+	thread_init();
+	thread_create(0, "main", tmain, 0);
+	thread_yield();
+	// never coming here!
 }
 
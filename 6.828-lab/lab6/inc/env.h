@@ -6,6 +6,7 @@
 #include <inc/types.h>
 #include <inc/trap.h>
 #include <inc/memlayout.h>
+#include <inc/syscall.h>
 
 typedef int32_t envid_t;
 
@@ -38,6 +39,13 @@ enum {
 	ENV_NOT_RUNNABLE
 };
 
+// Scheduling weights (see kern/sched.c).  Environments that want to
+// run share the CPU in proportion to their weights.
+#define ENV_WEIGHT_MIN		1
+#define ENV_WEIGHT_DEFAULT	10
+#define ENV_WEIGHT_SERVER	100	// File and network servers
+#define ENV_WEIGHT_MAX		1000
+
 // Special environment types
 enum EnvType {
 	ENV_TYPE_USER = 0,
@@ -54,6 +62,9 @@ struct Env {
 	unsigned env_status;		// Status of the environment
 	uint32_t env_runs;		// Number of times environment has run
 	int env_cpunum;			// The CPU that the env is running on
+	unsigned env_weight;		// Share of the CPU (ENV_WEIGHT_*)
+	uint32_t env_affinity;		// CPUs it may run on; bit i is cpus[i]
+	uint64_t env_pass;		// Stride scheduler's virtual time
 
 	// Address space
 	pde_t *env_pgdir;		// Kernel virtual address of page dir
@@ -67,6 +78,31 @@ struct Env {
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+	bool env_ipc_timed;		// Receive has a deadline (kern/time.c)
+	unsigned env_ipc_deadline;	// time_msec() at which it times out
+	struct Env *env_timeout_link;	// Next waiter with a later deadline
+
+	void *env_fpregs;		// Saved FPU registers, once it has
+					// used the FPU (see kern/env.c)
+
+	struct EnvStats *env_stats;	// Resource counters
+};
+
+// What an environment has used, kept by the kernel in trap() and
+// syscall().  envstats[ENVX(id)] belongs to the environment with that
+// id if es_id says so, and is mapped read-only for users at USTATS.
+// The counters of an environment that has exited stay until its slot
+// is reused.
+struct EnvStats {
+	envid_t es_id;			// Environment these belong to
+	uint32_t es_runs;		// Times scheduled
+	uint32_t es_ticks;		// Timer interrupts taken while running
+	uint32_t es_pgfaults;		// Page faults
+	uint64_t es_cycles;		// TSC cycles spent in user mode
+	uint32_t es_syscalls[NSYSCALLS]; // System calls made, by number
+	uint32_t es_ipc_sent;		// Messages sent
+	uint32_t es_ipc_recv;		// Messages received
+	uint32_t es_pages;		// Pages mapped below UTOP
 };
 
 #endif // !JOS_INC_ENV_H
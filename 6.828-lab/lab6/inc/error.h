@@ -26,6 +26,10 @@ enum {
 	E_NOT_EXEC	,	// File not a valid executable
 	E_NOT_SUPP	,	// Operation not supported
 
+	// Network error codes
+	E_AGAIN		,	// Device busy or no data yet; try again
+	E_TIMEOUT	,	// Timed out waiting
+
 	MAXERROR
 };
 
@@ -11,6 +11,7 @@
 struct Fd;
 struct Stat;
 struct Dev;
+struct Aio;
 
 // Per-device-class file descriptor operations
 struct Dev {
@@ -21,6 +22,21 @@ struct Dev {
 	int (*dev_close)(struct Fd *fd);
 	int (*dev_stat)(struct Fd *fd, struct Stat *stat);
 	int (*dev_trunc)(struct Fd *fd, off_t length);
+
+	// Asynchronous I/O (see lib/aio.c).  dev_aread and dev_awrite
+	// start 'aio' and return 0, or < 0 on error.  dev_await is called
+	// with the server's reply value once it arrives (or with 0 to poll
+	// devices without a server); it returns 1 after storing the
+	// operation's result in aio->aio_result, or 0 if it is not done.
+	int (*dev_aread)(struct Fd *fd, struct Aio *aio);
+	int (*dev_awrite)(struct Fd *fd, struct Aio *aio);
+	int (*dev_await)(struct Fd *fd, struct Aio *aio, int32_t value);
+
+	// Readiness (see poll in lib/fd.c).  Returns the POLL* events
+	// among 'events' that would not block right now, plus POLLHUP or
+	// POLLERR.  Devices without it are always ready; sockets are
+	// asked about all at once instead.
+	int (*dev_poll)(struct Fd *fd, int events);
 };
 
 struct FdFile {
@@ -43,6 +59,34 @@ struct Fd {
 	};
 };
 
+// Asynchronous I/O operations
+#define AIO_READ	0
+#define AIO_WRITE	1
+
+struct Aio {
+	int aio_state;		// AIO_FREE, AIO_PENDING or AIO_DONE (lib/aio.c)
+	int aio_op;		// AIO_READ or AIO_WRITE
+	int aio_fdnum;		// file descriptor the operation is on
+	void *aio_buf;		// caller's buffer
+	size_t aio_n;		// number of bytes requested
+	void *aio_page;		// request page, mapped back with the reply
+	envid_t aio_server;	// env that will reply, 0 if polled
+	ssize_t aio_result;	// bytes transferred, or < 0 on error
+};
+
+// poll events
+#define POLLIN		0x001	// data may be read without blocking
+#define POLLOUT		0x004	// data may be written without blocking
+#define POLLERR		0x008	// error condition
+#define POLLHUP		0x010	// the other end hung up
+#define POLLNVAL	0x020	// not an open file descriptor
+
+struct pollfd {
+	int fd;			// file descriptor, ignored if < 0
+	short events;		// events to watch for
+	short revents;		// events that happened
+};
+
 struct Stat {
 	char st_name[MAXNAMELEN];
 	off_t st_size;
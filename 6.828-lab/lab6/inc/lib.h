@@ -32,7 +32,9 @@ void	umain(int argc, char **argv);
 extern const char *binaryname;
 extern const volatile struct Env *thisenv;
 extern const volatile struct Env envs[NENV];
+extern const volatile struct EnvStats envstats[NENV];
 extern const volatile struct PageInfo pages[];
+extern const volatile struct Clock uclock;
 
 // exit.c
 void	exit(void);
@@ -44,6 +46,7 @@ void	set_pgfault_handler(void (*handler)(struct UTrapframe *utf));
 char*	readline(const char *buf);
 
 // syscall.c
+int	sysenter_enable(bool on);
 void	sys_cputs(const char *string, size_t len);
 int	sys_cgetc(void);
 envid_t	sys_getenvid(void);
@@ -59,7 +62,16 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
-unsigned int sys_time_msec(void);
+int	sys_ipc_recv_timeout(void *rcv_pg, unsigned int msec);
+int	sys_net_transmit(const void *buf, size_t len);
+int	sys_net_transmit_batch(const void *const *bufs, const size_t *lens, int n);
+int	sys_net_receive(void *buf, size_t len);
+int	sys_net_receive_page(void *va);
+int	sys_net_wait_receive(void);
+int	sys_net_set_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv);
+int	sys_sched_set_slice(unsigned msec);
+int	sys_env_set_weight(envid_t env, unsigned weight);
+int	sys_env_set_affinity(envid_t env, uint32_t mask);
 
 // This must be inlined.  Exercise for reader: why?
 static inline envid_t __attribute__((always_inline))
@@ -76,13 +88,29 @@ sys_exofork(void)
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int	ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 unsigned int msec);
+int	ipc_defer(envid_t from, int32_t value, void *va, int perm);
+bool	ipc_defer_full(void);
 envid_t	ipc_find_env(enum EnvType type);
 
+// Set in a request's IPC value to have the server map the request page
+// back along with its reply, so that the reply can be told apart from
+// others while asynchronous operations are in flight (see lib/aio.c).
+#define IPCREQ_ASYNC	0x40000000
+
 // fork.c
 #define	PTE_SHARE	0x400
 envid_t	fork(void);
 envid_t	sfork(void);	// Challenge!
 
+// aio.c
+int	aread(int fd, void *buf, size_t nbytes);
+int	awrite(int fd, const void *buf, size_t nbytes);
+int	await_any(ssize_t *result_store);
+int32_t	aio_ipc_recv(void *pg);
+int	aio_ipc_wait(int32_t value, unsigned msec);
+
 // fd.c
 int	close(int fd);
 ssize_t	read(int fd, void *buf, size_t nbytes);
@@ -93,6 +121,7 @@ ssize_t	readn(int fd, void *buf, size_t nbytes);
 int	dup(int oldfd, int newfd);
 int	fstat(int fd, struct Stat *statbuf);
 int	stat(const char *path, struct Stat *statbuf);
+int	poll(struct pollfd *fds, int nfds, int timeout);
 
 // file.c
 int	open(const char *path, int mode);
@@ -109,6 +138,7 @@ int     bind(int s, struct sockaddr *name, socklen_t namelen);
 int     shutdown(int s, int how);
 int     connect(int s, const struct sockaddr *name, socklen_t namelen);
 int     listen(int s, int backlog);
+int     sendfile(int out_sock, int in_fd, off_t offset, size_t count);
 int     socket(int domain, int type, int protocol);
 
 // nsipc.c
@@ -121,11 +151,22 @@ int     nsipc_listen(int s, int backlog);
 int     nsipc_recv(int s, void *mem, int len, unsigned int flags);
 int     nsipc_send(int s, const void *buf, int size, unsigned int flags);
 int     nsipc_socket(int domain, int type, int protocol);
+int     nsipc_sendfile(int s, int fileid, off_t offset, size_t count);
+int     nsipc_select(int maxfdp1, fd_set *readset, fd_set *writeset,
+		     fd_set *exceptset, int timeout);
+int     nsipc_stats(struct Nsret_stats *st);
+envid_t nsipc_arecv(int s, union Nsipc *req, int len, unsigned int flags);
+envid_t nsipc_asend(int s, union Nsipc *req, const void *buf, int size,
+		    unsigned int flags);
 
 // spawn.c
 envid_t	spawn(const char *program, const char **argv);
 envid_t	spawnl(const char *program, const char *arg0, ...);
 
+// clock.c
+unsigned int sys_time_msec(void);
+uint64_t time_usec(void);
+
 // console.c
 void	cputchar(int c);
 int	getchar(void);
@@ -136,6 +177,11 @@ int	opencons(void);
 int	pipe(int pipefds[2]);
 int	pipeisclosed(int pipefd);
 
+// The IPC value that wakes an environment waiting on a pipe.  One that
+// arrives after the waiter gave up is a stray, which receivers skip.
+#define PIPE_WAKEUP	0x50495045	// "PIPE"
+#define PIPE_STRAY(value, perm)	((value) == PIPE_WAKEUP && !((perm) & PTE_P))
+
 // wait.c
 void	wait(envid_t env);
 
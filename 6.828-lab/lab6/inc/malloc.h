@@ -3,5 +3,7 @@
 
 void *malloc(size_t size);
 void free(void *addr);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *addr, size_t size);
 
 #endif
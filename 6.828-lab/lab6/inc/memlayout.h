@@ -50,7 +50,11 @@
  *    UVPT      ---->  +------------------------------+ 0xef400000
  *                     |          RO PAGES            | R-/R-  PTSIZE
  *    UPAGES    ---->  +------------------------------+ 0xef000000
- *                     |           RO ENVS            | R-/R-  PTSIZE
+ *                     |          RO CLOCK            | R-/R-  PGSIZE
+ *    UCLOCK    ---->  +------------------------------+ 0xeefff000
+ *                     |        RO ENV STATS          | R-/R-  PTSIZE/2-PGSIZE
+ *    USTATS    ---->  +------------------------------+ 0xeee00000
+ *                     |           RO ENVS            | R-/R-  PTSIZE/2
  * UTOP,UENVS ------>  +------------------------------+ 0xeec00000
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
  *                     +------------------------------+ 0xeebff000
@@ -114,6 +118,11 @@
 #define UPAGES		(UVPT - PTSIZE)
 // Read-only copies of the global env structures
 #define UENVS		(UPAGES - PTSIZE)
+// Read-only per-environment counters (struct EnvStats), in the upper
+// half of the envs region
+#define USTATS		(UENVS + PTSIZE / 2)
+// Read-only clock page (struct Clock), in the last page of the envs region
+#define UCLOCK		(UPAGES - PGSIZE)
 
 /*
  * Top of user VM. User can manipulate VA from UTOP-1 and down!
@@ -186,5 +195,18 @@ struct PageInfo {
 	uint16_t pp_ref;
 };
 
+/*
+ * The clock page, mapped at UCLOCK.
+ * Read/write to the kernel, read-only to user programs, which can tell
+ * the time from it without a system call (see lib/clock.c).
+ *
+ * The kernel fills it in once, at boot, having calibrated the TSC.
+ * Time since boot is (TSC - clk_tsc_boot) / clk_tsc_khz milliseconds.
+ */
+struct Clock {
+	uint64_t clk_tsc_boot;		// TSC at time 0
+	uint32_t clk_tsc_khz;		// TSC cycles per millisecond
+};
+
 #endif /* !__ASSEMBLER__ */
 #endif /* !JOS_INC_MEMLAYOUT_H */
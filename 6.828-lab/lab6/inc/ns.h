@@ -6,12 +6,35 @@
 #include <inc/types.h>
 #include <inc/mmu.h>
 #include <lwip/sockets.h>
+#include <lwip/stats.h>
 
 struct jif_pkt {
 	int jp_len;
 	char jp_data[0];
 };
 
+// Transmit ring shared by the network server and its output environment
+// (see net/output.c).  The server copies frames into the slots from
+// jr_prod on; the output environment hands every slot from jr_cons up to
+// jr_prod to the card with one system call.  The counters only grow and
+// are taken modulo JIF_TXRING_NSLOTS.  Before the output environment
+// blocks in ipc_recv it sets jr_sleeping, and the next frame the server
+// queues wakes it with NSREQ_OUTPUT_RING.
+#define JIF_TXRING		0x0ff00000
+#define JIF_TXRING_NSLOTS	32
+#define JIF_TXRING_SLOTSIZE	2048
+#define JIF_TXRING_SIZE		(PGSIZE + JIF_TXRING_NSLOTS * JIF_TXRING_SLOTSIZE)
+
+struct jif_txring {
+	volatile uint32_t jr_prod;
+	volatile uint32_t jr_cons;
+	volatile uint32_t jr_sleeping;
+};
+
+#define JIF_TXRING_SLOT(ring, i)					\
+	((struct jif_pkt *) ((char *) (ring) + PGSIZE			\
+			     + ((i) % JIF_TXRING_NSLOTS) * JIF_TXRING_SLOTSIZE))
+
 // Definitions for requests from clients to network server
 enum {
 	// The following messages pass a page containing an Nsipc.
@@ -26,6 +49,12 @@ enum {
 	NSREQ_RECV,
 	NSREQ_SEND,
 	NSREQ_SOCKET,
+	// Sendfile sends file data mapped from the file server
+	NSREQ_SENDFILE,
+	// Select returns the ready sockets in the request's fd_sets.
+	NSREQ_SELECT,
+	// Stats returns a Nsret_stats on the request page.
+	NSREQ_STATS,
 
 	// The following two messages pass a page containing a struct jif_pkt
 	NSREQ_INPUT,
@@ -33,8 +62,9 @@ enum {
 	// network server, to the output environment
 	NSREQ_OUTPUT,
 
-	// The following message passes no page
-	NSREQ_TIMER,
+	// The following messages pass no page
+	// Sent to the output environment when the transmit ring has frames
+	NSREQ_OUTPUT_RING,
 };
 
 union Nsipc {
@@ -97,6 +127,32 @@ union Nsipc {
 		int req_protocol;
 	} socket;
 
+	struct Nsreq_sendfile {
+		int req_s;
+		int req_fileid;
+		off_t req_offset;
+		size_t req_count;
+	} sendfile;
+
+	struct Nsreq_select {
+		int req_maxfdp1;
+		fd_set req_readset;
+		fd_set req_writeset;
+		fd_set req_exceptset;
+		int req_timeout;	// in milliseconds, < 0 for none
+	} select;
+
+	struct Nsret_stats {
+		// Cycles spent in lwIP stages (net/lwip/jos/arch/perf.h)
+		int ret_nperf;
+		struct {
+			char name[16];
+			uint32_t calls;
+			uint64_t cycles;
+		} ret_perf[16];
+		struct stats_ ret_lwip;
+	} statsRet;
+
 	struct jif_pkt pkt;
 
 	// Ensure Nsipc is one page
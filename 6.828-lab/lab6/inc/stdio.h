@@ -1,6 +1,7 @@
 #ifndef JOS_INC_STDIO_H
 #define JOS_INC_STDIO_H
 
+#include <inc/types.h>
 #include <inc/stdarg.h>
 
 #ifndef NULL
@@ -27,6 +28,35 @@ int	printf(const char *fmt, ...);
 int	fprintf(int fd, const char *fmt, ...);
 int	vfprintf(int fd, const char *fmt, va_list);
 
+// lib/stdio.c
+typedef struct FILE FILE;
+
+#define BUFSIZ		1024	/* default stream buffer size */
+#define FOPEN_MAX	8	/* streams open at once, counting stdin/out/err */
+
+#define _IOFBF		0	/* fully buffered */
+#define _IOLBF		1	/* line buffered */
+#define _IONBF		2	/* unbuffered */
+
+extern FILE *const stdin;
+extern FILE *const stdout;
+extern FILE *const stderr;
+
+FILE*	fdopen(int fd, const char *mode);
+int	fclose(FILE *f);
+int	fflush(FILE *f);
+int	setvbuf(FILE *f, char *buf, int mode, size_t size);
+int	feof(FILE *f);
+int	ferror(FILE *f);
+int	fgetc(FILE *f);
+char*	fgets(char *s, int n, FILE *f);
+size_t	fread(void *buf, size_t size, size_t nmemb, FILE *f);
+int	fputc(int c, FILE *f);
+int	fputs(const char *s, FILE *f);
+size_t	fwrite(const void *buf, size_t size, size_t nmemb, FILE *f);
+int	bprintf(FILE *f, const char *fmt, ...);
+int	vbprintf(FILE *f, const char *fmt, va_list);
+
 // lib/readline.c
 char*	readline(const char *prompt);
 
@@ -18,6 +18,16 @@ enum {
 	SYS_ipc_try_send,
 	SYS_ipc_recv,
 	SYS_time_msec,
+	SYS_net_transmit,
+	SYS_net_transmit_batch,
+	SYS_net_receive,
+	SYS_net_receive_page,
+	SYS_net_wait_receive,
+	SYS_net_set_moderation,
+	SYS_ipc_recv_timeout,
+	SYS_sched_set_slice,
+	SYS_env_set_weight,
+	SYS_env_set_affinity,
 	NSYSCALLS
 };
 
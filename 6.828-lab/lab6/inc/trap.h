@@ -36,8 +36,10 @@
 #define IRQ_KBD          1
 #define IRQ_SERIAL       4
 #define IRQ_SPURIOUS     7
+#define IRQ_E1000       11
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      20	// IPI that wakes a halted CPU
 
 #ifndef __ASSEMBLER__
 
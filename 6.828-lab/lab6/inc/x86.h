@@ -157,6 +157,12 @@ rcr2(void)
 	return val;
 }
 
+static inline void
+clts(void)
+{
+	asm volatile("clts");
+}
+
 static inline void
 lcr3(uint32_t val)
 {
@@ -240,6 +246,45 @@ cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *e
 		*edxp = edx;
 }
 
+// Feature bits in %edx from cpuid(1)
+#define CPUID_EDX_SEP	0x00000800	// SYSENTER/SYSEXIT
+#define CPUID_EDX_FXSR	0x01000000	// FXSAVE/FXRSTOR
+#define CPUID_EDX_SSE	0x02000000
+#define CPUID_EDX_SSE2	0x04000000
+
+// Model-specific registers for SYSENTER
+#define MSR_IA32_SYSENTER_CS	0x174
+#define MSR_IA32_SYSENTER_ESP	0x175
+#define MSR_IA32_SYSENTER_EIP	0x176
+
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// Save and restore the FPU and SSE registers.  'p' must be 16-byte
+// aligned and 512 bytes long.
+static inline void
+fxsave(void *p)
+{
+	asm volatile("fxsave (%0)" : : "r" (p) : "memory");
+}
+
+static inline void
+fxrstor(const void *p)
+{
+	asm volatile("fxrstor (%0)" : : "r" (p) : "memory");
+}
+
 static inline uint64_t
 read_tsc(void)
 {
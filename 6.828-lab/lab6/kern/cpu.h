@@ -23,6 +23,7 @@ struct CpuInfo {
 	volatile unsigned cpu_status;   // The status of the CPU
 	struct Env *cpu_env;            // The currently-running environment.
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+	uint64_t cpu_user_tsc;          // TSC when cpu_env last entered user mode
 };
 
 // Initialized in mpconfig.c
@@ -42,5 +43,8 @@ void lapic_init(void);
 void lapic_startap(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 void lapic_ipi(int vector);
+void lapic_ipi_cpu(uint8_t apicid, int vector);
+void lapic_timer_oneshot(unsigned msec);
+void lapic_timer_stop(void);
 
 #endif
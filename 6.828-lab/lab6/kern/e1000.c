@@ -1,4 +1,339 @@
 #include <kern/e1000.h>
 #include <kern/pmap.h>
+#include <kern/env.h>
+#include <kern/picirq.h>
+#include <kern/sched.h>
+#include <inc/trap.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/error.h>
 
 // LAB 6: Your driver code here
+
+// Memory-mapped registers of the one 82540EM we drive
+static volatile uint32_t *e1000;
+
+#define E1000_REG(off)	(e1000[(off) / 4])
+
+// The descriptor rings live in the kernel's bss, which is physically
+// contiguous, so PADDR gives the bus address the card DMAs from.
+static struct tx_desc tx_ring[E1000_NTXDESC] __attribute__((aligned(16)));
+static struct rx_desc rx_ring[E1000_NRXDESC] __attribute__((aligned(16)));
+
+// Transmit buffers, two to a page.  They come from page_alloc rather
+// than the bss, which would push the kernel past what
+// entry_pgdir maps.
+static uint8_t *tx_bufs[E1000_NTXDESC];
+
+// Each receive descriptor owns a whole page, and the card DMAs frames
+// E1000_RXPAGE_OFF bytes into it.  e1000_receive_page trades a full
+// page for an empty one from the caller, so received frames reach
+// user space without being copied.
+static struct PageInfo *rx_pages[E1000_NRXDESC];
+
+// Next transmit descriptor to fill.  The hardware's TDT only catches up
+// with this when the queued packets are handed over in e1000_tx_kick.
+static uint32_t tx_tail;
+
+// Whether the card's interrupt line is wired to e1000_intr, and the
+// environment (if any) blocked in e1000_wait_receive.
+static bool e1000_irq;
+static envid_t rx_waiter;
+
+// QEMU's default MAC address, 52:54:00:12:34:56
+static const uint8_t e1000_mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+
+// Fill bufs[0..n) with E1000_BUFSIZE-byte buffers carved out of
+// freshly allocated pages.
+static void
+e1000_alloc_bufs(uint8_t **bufs, int n)
+{
+	struct PageInfo *pp = NULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (i % (PGSIZE / E1000_BUFSIZE) == 0) {
+			if (!(pp = page_alloc(ALLOC_ZERO)))
+				panic("e1000: out of memory for packet buffers");
+			pp->pp_ref++;
+		}
+		bufs[i] = (uint8_t *) page2kva(pp) + (i % (PGSIZE / E1000_BUFSIZE)) * E1000_BUFSIZE;
+	}
+}
+
+static void
+e1000_tx_init(void)
+{
+	int i;
+
+	e1000_alloc_bufs(tx_bufs, E1000_NTXDESC);
+	for (i = 0; i < E1000_NTXDESC; i++) {
+		tx_ring[i].addr = PADDR(tx_bufs[i]);
+		// All descriptors start out free
+		tx_ring[i].status = E1000_TXD_STAT_DD;
+	}
+
+	E1000_REG(E1000_TDBAL) = PADDR(tx_ring);
+	E1000_REG(E1000_TDBAH) = 0;
+	E1000_REG(E1000_TDLEN) = sizeof(tx_ring);
+	E1000_REG(E1000_TDH) = 0;
+	E1000_REG(E1000_TDT) = 0;
+	tx_tail = 0;
+
+	E1000_REG(E1000_TCTL) = E1000_TCTL_EN | E1000_TCTL_PSP
+		| (0x10 << E1000_TCTL_CT_SHIFT)
+		| (0x40 << E1000_TCTL_COLD_SHIFT);
+	E1000_REG(E1000_TIPG) = E1000_TIPG_IPGT
+		| (E1000_TIPG_IPGR1 << E1000_TIPG_IPGR1_SHIFT)
+		| (E1000_TIPG_IPGR2 << E1000_TIPG_IPGR2_SHIFT);
+}
+
+static void
+e1000_rx_init(void)
+{
+	int i;
+
+	E1000_REG(E1000_RAL) = e1000_mac[0] | (e1000_mac[1] << 8)
+		| (e1000_mac[2] << 16) | (e1000_mac[3] << 24);
+	E1000_REG(E1000_RAH) = e1000_mac[4] | (e1000_mac[5] << 8)
+		| E1000_RAH_AV;
+	for (i = 0; i < 128; i++)
+		E1000_REG(E1000_MTA + i * 4) = 0;
+
+	E1000_REG(E1000_IMC) = 0xffffffff;
+
+	for (i = 0; i < E1000_NRXDESC; i++) {
+		if (!(rx_pages[i] = page_alloc(ALLOC_ZERO)))
+			panic("e1000: out of memory for receive pages");
+		rx_pages[i]->pp_ref++;
+		rx_ring[i].addr = page2pa(rx_pages[i]) + E1000_RXPAGE_OFF;
+		rx_ring[i].status = 0;
+	}
+
+	E1000_REG(E1000_RDBAL) = PADDR(rx_ring);
+	E1000_REG(E1000_RDBAH) = 0;
+	E1000_REG(E1000_RDLEN) = sizeof(rx_ring);
+	// Head == tail means the ring is full of packets to the card,
+	// so give it all but one descriptor.
+	E1000_REG(E1000_RDH) = 0;
+	E1000_REG(E1000_RDT) = E1000_NRXDESC - 1;
+
+	E1000_REG(E1000_RCTL) = E1000_RCTL_EN | E1000_RCTL_BAM
+		| E1000_RCTL_SZ_2048 | E1000_RCTL_SECRC;
+}
+
+int
+e1000_attach(struct pci_func *pcif)
+{
+	static_assert(sizeof(tx_ring) % 128 == 0);
+	static_assert(sizeof(rx_ring) % 128 == 0);
+
+	pci_func_enable(pcif);
+	e1000 = mmio_map_region(pcif->reg_base[0], pcif->reg_size[0]);
+	cprintf("e1000: status 0x%08x\n", E1000_REG(E1000_STATUS));
+
+	e1000_tx_init();
+	e1000_rx_init();
+
+	// Receive interrupts wake the input environment instead of it
+	// polling; trap.c only has a vector for the usual QEMU line.
+	if (pcif->irq_line == IRQ_E1000) {
+		e1000_set_moderation(E1000_ITR_DEFAULT, E1000_RDTR_DEFAULT,
+				     E1000_RADV_DEFAULT);
+		irq_setmask_8259A(irq_mask_8259A & ~(1 << IRQ_E1000));
+		E1000_REG(E1000_IMS) = E1000_RX_INTRS;
+		e1000_irq = 1;
+	} else
+		cprintf("e1000: irq %d has no handler, polling\n",
+			pcif->irq_line);
+	return 1;
+}
+
+// Copy one packet into the next free transmit descriptor without
+// telling the card.  Returns 0, or -E_AGAIN if the ring is full.
+static int
+e1000_tx_queue(const void *buf, size_t len)
+{
+	struct tx_desc *td = &tx_ring[tx_tail];
+
+	if (!(td->status & E1000_TXD_STAT_DD))
+		return -E_AGAIN;
+
+	memmove(tx_bufs[tx_tail], buf, len);
+	td->length = len;
+	td->cmd = E1000_TXD_CMD_RS | E1000_TXD_CMD_EOP;
+	td->status = 0;
+	tx_tail = (tx_tail + 1) % E1000_NTXDESC;
+	return 0;
+}
+
+// Hand every queued descriptor to the card with one tail write.
+static void
+e1000_tx_kick(void)
+{
+	// The descriptors must be in memory before the card hears of them
+	asm volatile("" ::: "memory");
+	E1000_REG(E1000_TDT) = tx_tail;
+}
+
+// Transmit one packet.
+// Returns 0 on success, -E_INVAL if the packet is too large, or
+// -E_AGAIN if the transmit ring is full.
+int
+e1000_transmit(const void *buf, size_t len)
+{
+	int r;
+
+	if (!e1000)
+		return -E_NOT_SUPP;
+	if (len > E1000_MAXPKT)
+		return -E_INVAL;
+	if ((r = e1000_tx_queue(buf, len)) < 0)
+		return r;
+	e1000_tx_kick();
+	return 0;
+}
+
+// Transmit up to 'n' packets, handing all of them to the card with a
+// single doorbell write.  Returns the number of packets queued, which
+// is less than 'n' if the ring filled up, or < 0 on error.
+int
+e1000_transmit_batch(const void *const *bufs, const size_t *lens, int n)
+{
+	int i;
+
+	if (!e1000)
+		return -E_NOT_SUPP;
+	for (i = 0; i < n; i++) {
+		if (lens[i] > E1000_MAXPKT)
+			break;
+		if (e1000_tx_queue(bufs[i], lens[i]) < 0)
+			break;
+	}
+	if (i > 0)
+		e1000_tx_kick();
+	if (i == 0 && n > 0)
+		return lens[0] > E1000_MAXPKT ? -E_INVAL : -E_AGAIN;
+	return i;
+}
+
+// Return the index of the next descriptor holding a received frame,
+// or -E_AGAIN if there is none.
+static int
+e1000_rx_next(void)
+{
+	uint32_t next;
+
+	if (!e1000)
+		return -E_NOT_SUPP;
+	next = (E1000_REG(E1000_RDT) + 1) % E1000_NRXDESC;
+	if (!(rx_ring[next].status & E1000_RXD_STAT_DD))
+		return -E_AGAIN;
+	return next;
+}
+
+// Give descriptor 'i' back to the card.
+static void
+e1000_rx_done(int i)
+{
+	rx_ring[i].status = 0;
+	asm volatile("" ::: "memory");
+	E1000_REG(E1000_RDT) = i;
+}
+
+// Receive one packet into 'buf', which holds 'len' bytes.
+// Returns the packet's length, -E_AGAIN if no packet has arrived, or
+// -E_INVAL if 'buf' is too small (the packet stays queued).
+int
+e1000_receive(void *buf, size_t len)
+{
+	int i;
+
+	if ((i = e1000_rx_next()) < 0)
+		return i;
+	// Buffers are as large as the largest frame, so every packet
+	// fits in one descriptor.
+	if (rx_ring[i].length > len)
+		return -E_INVAL;
+
+	len = rx_ring[i].length;
+	memmove(buf, (char *) page2kva(rx_pages[i]) + E1000_RXPAGE_OFF, len);
+	e1000_rx_done(i);
+	return len;
+}
+
+// Receive one packet without copying it: the page holding the frame
+// (at E1000_RXPAGE_OFF) is returned in *full_store, carrying the
+// reference the ring held, and 'empty' takes its place in the ring.
+// Returns the packet's length, or -E_AGAIN if no packet has arrived.
+int
+e1000_receive_page(struct PageInfo *empty, struct PageInfo **full_store)
+{
+	int i, len;
+
+	if ((i = e1000_rx_next()) < 0)
+		return i;
+
+	len = rx_ring[i].length;
+	*full_store = rx_pages[i];
+	empty->pp_ref++;
+	rx_pages[i] = empty;
+	rx_ring[i].addr = page2pa(empty) + E1000_RXPAGE_OFF;
+	e1000_rx_done(i);
+	return len;
+}
+
+// Set receive interrupt moderation; see E1000_ITR_DEFAULT.
+int
+e1000_set_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv)
+{
+	if (!e1000)
+		return -E_NOT_SUPP;
+	if (itr > 0xffff || rdtr > 0xffff || radv > 0xffff)
+		return -E_INVAL;
+	E1000_REG(E1000_ITR) = itr;
+	E1000_REG(E1000_RDTR) = rdtr;
+	E1000_REG(E1000_RADV) = radv;
+	return 0;
+}
+
+// Block environment 'envid' until a frame may have arrived.
+// Returns 0 if a frame is already waiting, -E_NOT_SUPP if there are no
+// receive interrupts (the caller should poll), or marks the environment
+// not runnable and returns 1; e1000_intr makes it runnable again.
+int
+e1000_wait_receive(envid_t envid)
+{
+	struct Env *e;
+	int r;
+
+	if (!e1000_irq)
+		return -E_NOT_SUPP;
+	if (e1000_rx_next() >= 0)
+		return 0;
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	rx_waiter = envid;
+	e->env_status = ENV_NOT_RUNNABLE;
+	return 1;
+}
+
+// Handle an interrupt from the card.
+void
+e1000_intr(void)
+{
+	struct Env *e;
+	uint32_t icr;
+
+	// Reading ICR acknowledges every pending cause
+	icr = E1000_REG(E1000_ICR);
+	if (!(icr & E1000_RX_INTRS) || !rx_waiter)
+		return;
+	if (envid2env(rx_waiter, &e, 0) == 0
+	    && e->env_status == ENV_NOT_RUNNABLE) {
+		e->env_tf.tf_regs.reg_eax = 0;
+		e->env_status = ENV_RUNNABLE;
+		sched_wake(e);
+	}
+	rx_waiter = 0;
+}
@@ -1,3 +1,133 @@
 #ifndef JOS_KERN_E1000_H
 #define JOS_KERN_E1000_H
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+#include <inc/env.h>
+#include <kern/pci.h>
+
+#define E1000_VENDOR_ID		0x8086
+#define E1000_DEV_ID_82540EM	0x100E
+
+// Register offsets, in bytes from the start of BAR 0
+// (see 13.4 of the 8254x Software Developer's Manual)
+#define E1000_CTRL	0x00000	/* Device Control - RW */
+#define E1000_STATUS	0x00008	/* Device Status - RO */
+#define E1000_ICR	0x000C0	/* Interrupt Cause Read - R/clr */
+#define E1000_IMS	0x000D0	/* Interrupt Mask Set - RW */
+#define E1000_ITR	0x000C4	/* Interrupt Throttling Rate - RW */
+#define E1000_IMC	0x000D8	/* Interrupt Mask Clear - WO */
+#define E1000_RCTL	0x00100	/* RX Control - RW */
+#define E1000_TCTL	0x00400	/* TX Control - RW */
+#define E1000_TIPG	0x00410	/* TX Inter-packet gap -RW */
+#define E1000_RDBAL	0x02800	/* RX Descriptor Base Address Low - RW */
+#define E1000_RDBAH	0x02804	/* RX Descriptor Base Address High - RW */
+#define E1000_RDLEN	0x02808	/* RX Descriptor Length - RW */
+#define E1000_RDH	0x02810	/* RX Descriptor Head - RW */
+#define E1000_RDT	0x02818	/* RX Descriptor Tail - RW */
+#define E1000_RDTR	0x02820	/* RX Delay Timer - RW */
+#define E1000_RADV	0x0282C	/* RX Interrupt Absolute Delay Timer - RW */
+#define E1000_TDBAL	0x03800	/* TX Descriptor Base Address Low - RW */
+#define E1000_TDBAH	0x03804	/* TX Descriptor Base Address High - RW */
+#define E1000_TDLEN	0x03808	/* TX Descriptor Length - RW */
+#define E1000_TDH	0x03810	/* TX Descriptor Head - RW */
+#define E1000_TDT	0x03818	/* TX Descripotr Tail - RW */
+#define E1000_MTA	0x05200	/* Multicast Table Array - RW Array */
+#define E1000_RAL	0x05400	/* Receive Address Low - RW */
+#define E1000_RAH	0x05404	/* Receive Address High - RW */
+
+// Transmit Control
+#define E1000_TCTL_EN		0x00000002	/* enable tx */
+#define E1000_TCTL_PSP		0x00000008	/* pad short packets */
+#define E1000_TCTL_CT_SHIFT	4		/* collision threshold */
+#define E1000_TCTL_COLD_SHIFT	12		/* collision distance */
+
+// Transmit Inter Packet Gap, recommended values for IEEE 802.3
+#define E1000_TIPG_IPGT		10
+#define E1000_TIPG_IPGR1_SHIFT	10
+#define E1000_TIPG_IPGR1	4
+#define E1000_TIPG_IPGR2_SHIFT	20
+#define E1000_TIPG_IPGR2	6
+
+// Receive Control
+#define E1000_RCTL_EN		0x00000002	/* enable */
+#define E1000_RCTL_BAM		0x00008000	/* broadcast enable */
+#define E1000_RCTL_SZ_2048	0x00000000	/* rx buffer size 2048 */
+#define E1000_RCTL_SECRC	0x04000000	/* Strip Ethernet CRC */
+
+#define E1000_RAH_AV		0x80000000	/* Receive address valid */
+
+// Interrupt causes, for ICR and IMS
+#define E1000_ICR_RXDMT0	0x00000010	/* rx desc min. threshold */
+#define E1000_ICR_RXO		0x00000040	/* rx overrun */
+#define E1000_ICR_RXT0		0x00000080	/* rx timer intr */
+#define E1000_RX_INTRS		(E1000_ICR_RXDMT0 | E1000_ICR_RXO | E1000_ICR_RXT0)
+
+// Receive interrupt moderation defaults.  ITR caps the interrupt rate
+// (units of 256ns between interrupts; 488 is about 8000 per second).
+// RDTR delays the receive interrupt after each frame and RADV bounds
+// the total delay (units of 1.024us).  Override with KERN_CFLAGS or at
+// run time with sys_net_set_moderation.
+#ifndef E1000_ITR_DEFAULT
+#define E1000_ITR_DEFAULT	488
+#endif
+#ifndef E1000_RDTR_DEFAULT
+#define E1000_RDTR_DEFAULT	0
+#endif
+#ifndef E1000_RADV_DEFAULT
+#define E1000_RADV_DEFAULT	0
+#endif
+
+// Transmit descriptor bits
+#define E1000_TXD_CMD_EOP	0x01	/* End of Packet */
+#define E1000_TXD_CMD_RS	0x08	/* Report Status */
+#define E1000_TXD_STAT_DD	0x01	/* Descriptor Done */
+
+// Receive descriptor bits
+#define E1000_RXD_STAT_DD	0x01	/* Descriptor Done */
+#define E1000_RXD_STAT_EOP	0x02	/* End of Packet */
+
+// Legacy transmit descriptor (3.3.3)
+struct tx_desc {
+	uint64_t addr;
+	uint16_t length;
+	uint8_t cso;
+	uint8_t cmd;
+	uint8_t status;
+	uint8_t css;
+	uint16_t special;
+} __attribute__((packed));
+
+// Receive descriptor (3.2.3)
+struct rx_desc {
+	uint64_t addr;
+	uint16_t length;
+	uint16_t csum;
+	uint8_t status;
+	uint8_t errors;
+	uint16_t special;
+} __attribute__((packed));
+
+// Ring sizes.  Each ring must be a multiple of 128 bytes, i.e. of
+// 8 descriptors.
+#define E1000_NTXDESC	64
+#define E1000_NRXDESC	128
+
+// Largest Ethernet frame without CRC, and the size of each buffer
+#define E1000_MAXPKT	1518
+#define E1000_BUFSIZE	2048
+
+// Offset of a received frame in its page, leaving room for the length
+// word of a struct jif_pkt (inc/ns.h) in front of it
+#define E1000_RXPAGE_OFF	4
+
+int e1000_attach(struct pci_func *pcif);
+int e1000_transmit(const void *buf, size_t len);
+int e1000_transmit_batch(const void *const *bufs, const size_t *lens, int n);
+int e1000_receive(void *buf, size_t len);
+int e1000_receive_page(struct PageInfo *empty, struct PageInfo **full_store);
+int e1000_wait_receive(envid_t envid);
+int e1000_set_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv);
+void e1000_intr(void);
+
 #endif  // SOL >= 6
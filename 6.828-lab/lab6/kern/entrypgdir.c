@@ -2,6 +2,7 @@
 #include <inc/memlayout.h>
 
 pte_t entry_pgtable[NPTENTRIES];
+pte_t entry_pgtable_hi[NPTENTRIES];
 
 // The entry.S page directory maps the first 4MB of physical memory
 // starting at virtual address KERNBASE (that is, it maps virtual
@@ -12,6 +13,10 @@ pte_t entry_pgtable[NPTENTRIES];
 // region is critical for a few instructions in entry.S and then we
 // never use it again.
 //
+// The kernel carries every user program linked into it, which can take
+// it past 4MB, so [KERNBASE+4MB, KERNBASE+8MB) is mapped as well.  That
+// page table is filled in by entry.S.
+//
 // Page directories (and page tables), must start on a page boundary,
 // hence the "__aligned__" attribute.  Also, because of restrictions
 // related to linking and static initializers, we use "x + PTE_P"
@@ -24,9 +29,16 @@ pde_t entry_pgdir[NPDENTRIES] = {
 		= ((uintptr_t)entry_pgtable - KERNBASE) + PTE_P,
 	// Map VA's [KERNBASE, KERNBASE+4MB) to PA's [0, 4MB)
 	[KERNBASE>>PDXSHIFT]
-		= ((uintptr_t)entry_pgtable - KERNBASE) + PTE_P + PTE_W
+		= ((uintptr_t)entry_pgtable - KERNBASE) + PTE_P + PTE_W,
+	// Map VA's [KERNBASE+4MB, KERNBASE+8MB) to PA's [4MB, 8MB)
+	[(KERNBASE>>PDXSHIFT) + 1]
+		= ((uintptr_t)entry_pgtable_hi - KERNBASE) + PTE_P + PTE_W
 };
 
+// Filled in by entry.S
+__attribute__((__aligned__(PGSIZE)))
+pte_t entry_pgtable_hi[NPTENTRIES];
+
 // Entry 0 of the page table maps to physical page 0, entry 1 to
 // physical page 1, etc.
 __attribute__((__aligned__(PGSIZE)))
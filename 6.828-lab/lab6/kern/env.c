@@ -14,13 +14,24 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/time.h>
 
 struct Env *envs = NULL;		// All environments
+struct EnvStats *envstats = NULL;	// Their counters, mapped at USTATS
 static struct Env *env_free_list;	// Free environment list
 					// (linked by Env->env_link)
 
 #define ENVGENSHIFT	12		// >= LOGNENV
 
+// FPU and SSE registers of the environments that use them, saved on
+// every trap into the kernel and restored by env_run.  Environments
+// that never touch the FPU run with CR0_TS set; their first FPU or SSE
+// instruction traps to env_fpu_trap, which gives them a page to save
+// the registers in, starting off with fpu_clean.  Without FXSAVE none
+// of this happens.
+static uint8_t fpu_clean[512] __attribute__((aligned(16)));
+static bool env_fxsr;
+
 // Global descriptor table.
 //
 // Set up global descriptor table (GDT) with separate segments for
@@ -125,17 +136,28 @@ env_init(void)
 		//头插法
 		envs[i].env_id = 0;
 		envs[i].env_status = ENV_FREE;
+		envs[i].env_stats = &envstats[i];
 		envs[i].env_link = env_free_list;
 		env_free_list = &envs[i];
 	}
 	// Per-CPU part of the initialization
 	env_init_percpu();
+
+	// The state a freshly reset FPU is in
+	if (env_fxsr) {
+		clts();
+		asm volatile("fninit");
+		fxsave(fpu_clean);
+		lcr0(rcr0() | CR0_TS);
+	}
 }
 
 // Load GDT and segment descriptors.
 void
 env_init_percpu(void)
 {
+	uint32_t edx;
+
 	lgdt(&gdt_pd);
 	// The kernel never uses GS or FS, so we leave those set to
 	// the user data segment.
@@ -151,6 +173,104 @@ env_init_percpu(void)
 	// For good measure, clear the local descriptor table (LDT),
 	// since we don't use it.
 	lldt(0);
+
+	// Let environments use the FPU and SSE, trapping on first use
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_EDX_FXSR) {
+		env_fxsr = 1;
+		lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+		lcr0((rcr0() & ~CR0_EM) | CR0_MP | CR0_TS);
+	}
+}
+
+// Called on each trap from environment e: save its FPU registers
+// if it uses them.
+void
+env_fpu_save(struct Env *e)
+{
+	if (e->env_fpregs)
+		fxsave(e->env_fpregs);
+}
+
+// Allocate a page for e's FPU registers.
+// Returns 0, or -E_NO_MEM if there is no memory for it.
+static int
+env_fpu_alloc(struct Env *e)
+{
+	struct PageInfo *pp;
+
+	if (!(pp = page_alloc(0)))
+		return -E_NO_MEM;
+	pp->pp_ref++;
+	e->env_fpregs = page2kva(pp);
+	return 0;
+}
+
+// Environment e executed its first FPU or SSE instruction.
+// Give it a clean FPU, which env_run will load.
+// Returns 0, or -E_NO_MEM if there is no memory for its registers.
+int
+env_fpu_trap(struct Env *e)
+{
+	int r;
+
+	if ((r = env_fpu_alloc(e)) < 0)
+		return r;
+	memmove(e->env_fpregs, fpu_clean, sizeof(fpu_clean));
+	return 0;
+}
+
+// Charge 'e', which just trapped into the kernel, for the time it has
+// spent in user mode since it last left it.
+void
+env_charge(struct Env *e)
+{
+	e->env_stats->es_cycles += read_tsc() - thiscpu->cpu_user_tsc;
+	sched_charge(e);
+}
+
+// page_insert 'pp' at 'va' in e's address space, counting the pages
+// it has mapped.
+int
+env_page_insert(struct Env *e, struct PageInfo *pp, void *va, int perm)
+{
+	pte_t *pte = pgdir_walk(e->env_pgdir, va, 0);
+	bool mapped = pte && (*pte & PTE_P);
+	int r;
+
+	if ((r = page_insert(e->env_pgdir, pp, va, perm)) < 0)
+		return r;
+	if (!mapped)
+		e->env_stats->es_pages++;
+	return 0;
+}
+
+// page_remove whatever is at 'va' in e's address space, counting the
+// pages it has mapped.
+void
+env_page_remove(struct Env *e, void *va)
+{
+	pte_t *pte = pgdir_walk(e->env_pgdir, va, 0);
+
+	if (pte && (*pte & PTE_P)) {
+		page_remove(e->env_pgdir, va);
+		e->env_stats->es_pages--;
+	}
+}
+
+// A forked child starts with a copy of its parent's FPU registers.
+// Returns 0, or -E_NO_MEM if there is no memory for them.
+int
+env_fpu_fork(struct Env *child, struct Env *parent)
+{
+	int r;
+
+	if (!parent->env_fpregs)
+		return 0;
+	if ((r = env_fpu_alloc(child)) < 0)
+		return r;
+	memmove(child->env_fpregs, parent->env_fpregs, sizeof(fpu_clean));
+	return 0;
 }
 
 //
@@ -238,6 +358,11 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	memset(e->env_stats, 0, sizeof(*e->env_stats));
+	e->env_stats->es_id = e->env_id;
+	e->env_weight = ENV_WEIGHT_DEFAULT;
+	e->env_affinity = ~0;
+	e->env_pass = 0;
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -268,6 +393,8 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
+	e->env_ipc_timed = 0;
+	e->env_fpregs = NULL;
 
 	// commit the allocation
 	env_free_list = e->env_link;
@@ -300,7 +427,7 @@ region_alloc(struct Env *e, void *va, size_t len)
 	int result;
 	for(uintptr_t i = va_start; i < va_end; i += PGSIZE) {
 		p = page_alloc(ALLOC_ZERO);
-		result = page_insert(e->env_pgdir,p,(void *)i,PTE_W | PTE_U);
+		result = env_page_insert(e, p, (void *)i, PTE_W | PTE_U);
 		if( p == NULL || result != 0) {
 			cprintf("region_alloc:allocate memory failed");
 		}
@@ -408,6 +535,10 @@ env_create(uint8_t *binary, enum EnvType type)
 		//must be 3, plz see intel manual volume 1 page 406
 		new_env->env_tf.tf_eflags |= FL_IOPL_3;
 	}
+	// The servers sit between clients and the disk or network, so
+	// they go ahead of other work when they have requests
+	if (type == ENV_TYPE_FS || type == ENV_TYPE_NS)
+		new_env->env_weight = ENV_WEIGHT_SERVER;
 }
 
 //
@@ -426,6 +557,9 @@ env_free(struct Env *e)
 	if (e == curenv)
 		lcr3(PADDR(kern_pgdir));
 
+	// It can no longer time out of a receive
+	time_cancel_timeout(e);
+
 	// Note the environment's demise.
 	cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
@@ -444,7 +578,7 @@ env_free(struct Env *e)
 		// unmap all PTEs in this page table
 		for (pteno = 0; pteno <= PTX(~0); pteno++) {
 			if (pt[pteno] & PTE_P)
-				page_remove(e->env_pgdir, PGADDR(pdeno, pteno, 0));
+				env_page_remove(e, PGADDR(pdeno, pteno, 0));
 		}
 
 		// free the page table itself
@@ -457,6 +591,12 @@ env_free(struct Env *e)
 	e->env_pgdir = 0;
 	page_decref(pa2page(pa));
 
+	// and the FPU registers
+	if (e->env_fpregs) {
+		page_decref(pa2page(PADDR(e->env_fpregs)));
+		e->env_fpregs = NULL;
+	}
+
 	// return the environment to the free list
 	e->env_status = ENV_FREE;
 	e->env_link = env_free_list;
@@ -544,8 +684,14 @@ env_run(struct Env *e)
 	curenv->env_status = ENV_RUNNING;
 	curenv->env_runs++;
 	lcr3(PADDR(curenv->env_pgdir));
+	if (e->env_fpregs) {
+		clts();
+		fxrstor(e->env_fpregs);
+	} else if (env_fxsr && !(rcr0() & CR0_TS))
+		lcr0(rcr0() | CR0_TS);
 	unlock_kernel();
 	// cprintf("eax:%d\n",curenv->env_tf.tf_regs.reg_eax);
+	thiscpu->cpu_user_tsc = read_tsc();
 	env_pop_tf(&(curenv->env_tf));
 	// panic("env_run not yet implemented");
 }
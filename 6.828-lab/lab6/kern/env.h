@@ -7,6 +7,7 @@
 #include <kern/cpu.h>
 
 extern struct Env *envs;		// All environments
+extern struct EnvStats *envstats;	// Their counters
 #define curenv (thiscpu->cpu_env)		// Current environment
 extern struct Segdesc gdt[];
 
@@ -17,6 +18,14 @@ void	env_free(struct Env *e);
 void	env_create(uint8_t *binary, enum EnvType type);
 void	env_destroy(struct Env *e);	// Does not return if e == curenv
 
+void	env_fpu_save(struct Env *e);
+int	env_fpu_trap(struct Env *e);
+int	env_fpu_fork(struct Env *child, struct Env *parent);
+
+void	env_charge(struct Env *e);
+int	env_page_insert(struct Env *e, struct PageInfo *pp, void *va, int perm);
+void	env_page_remove(struct Env *e, void *va);
+
 int	envid2env(envid_t envid, struct Env **env_store, bool checkperm);
 // The following two functions do not return
 void	env_run(struct Env *e) __attribute__((noreturn));
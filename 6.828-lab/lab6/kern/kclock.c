@@ -1,8 +1,13 @@
 /* See COPYRIGHT for copyright information. */
 
-/* Support for reading the NVRAM from the real-time clock. */
+/*
+ * Support for reading the NVRAM from the real-time clock, and for
+ * timing short delays with the PIT, against which the kernel
+ * calibrates its other clocks.
+ */
 
 #include <inc/x86.h>
+#include <inc/assert.h>
 
 #include <kern/kclock.h>
 
@@ -20,3 +25,21 @@ mc146818_write(unsigned reg, unsigned datum)
 	outb(IO_RTC, reg);
 	outb(IO_RTC+1, datum);
 }
+
+// Busy-wait for 'msec' milliseconds, at most 54, on timer 2 of the
+// PIT, the one that normally drives the speaker.  In mode 0 its output
+// goes high when the count reaches zero, and the PPI lets us read it.
+void
+pit_delay(unsigned msec)
+{
+	unsigned count = TIMER_FREQ / 1000 * msec;
+
+	assert(count > 0 && count <= 0xffff);
+	// Gate timer 2 on, with the speaker off
+	outb(IO_PPI, (inb(IO_PPI) & ~PPI_SPKR) | PPI_GATE2);
+	outb(TIMER_MODE, TIMER_SEL2 | TIMER_16BIT | TIMER_INTTC);
+	outb(TIMER_CNTR2, count & 0xff);
+	outb(TIMER_CNTR2, count >> 8);
+	while (!(inb(IO_PPI) & PPI_OUT2))
+		;
+}
@@ -23,7 +23,21 @@
 #define NVRAM_EXT16LO	(MC_NVRAM_START + 38)	/* low byte; RTC off. 0x34 */
 #define NVRAM_EXT16HI	(MC_NVRAM_START + 39)	/* high byte; RTC off. 0x35 */
 
+#define	IO_TIMER1	0x040		/* 8253/8254 Timer #1 */
+#define	TIMER_FREQ	1193182		/* PIT input clock, Hz */
+#define	TIMER_CNTR2	(IO_TIMER1 + 2)	/* timer 2 counter port */
+#define	TIMER_MODE	(IO_TIMER1 + 3)	/* timer mode port */
+#define	TIMER_SEL2	0x80		/* select counter 2 */
+#define	TIMER_INTTC	0x00		/* mode 0, intr on terminal cnt */
+#define	TIMER_16BIT	0x30		/* r/w counter 16 bits, LSB first */
+
+#define	IO_PPI		0x061		/* 8255 PPI: speaker and timer 2 */
+#define	PPI_GATE2	0x01		/* timer 2 gate */
+#define	PPI_SPKR	0x02		/* timer 2 drives the speaker */
+#define	PPI_OUT2	0x20		/* timer 2 output (read only) */
+
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
+void pit_delay(unsigned msec);
 
 #endif	// !JOS_KERN_KCLOCK_H
@@ -6,9 +6,11 @@
 #include <inc/trap.h>
 #include <inc/mmu.h>
 #include <inc/stdio.h>
+#include <inc/assert.h>
 #include <inc/x86.h>
 #include <kern/pmap.h>
 #include <kern/cpu.h>
+#include <kern/kclock.h>
 
 // Local APIC registers, divided by 4 for use as uint32_t[] indices.
 #define ID      (0x0020/4)   // ID
@@ -33,6 +35,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
 	#define X1         0x0000000B   // divide counts by 1
 	#define PERIODIC   0x00020000   // Periodic
+	#define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -45,6 +48,13 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+// Timer counts per millisecond.  The boot CPU measures it against the
+// PIT; the others share its bus clock.
+static uint32_t lapic_timer_khz;
+
+// How long to measure the timer for, in ms
+#define CALIBRATE_MSEC	10
+
 static void
 lapicw(int index, int value)
 {
@@ -52,6 +62,23 @@ lapicw(int index, int value)
 	lapic[ID];  // wait for write to finish, by reading
 }
 
+// Count how fast the timer runs down while the PIT times a delay.
+static void
+lapic_calibrate(void)
+{
+	uint32_t count;
+
+	lapicw(TIMER, MASKED);
+	lapicw(TICR, 0xffffffff);
+	pit_delay(CALIBRATE_MSEC);
+	count = 0xffffffff - lapic[TCCR];
+	lapicw(TICR, 0);
+	lapic_timer_khz = count / CALIBRATE_MSEC;
+	if (!lapic_timer_khz)
+		panic("lapic_calibrate: the timer does not run");
+	cprintf("LAPIC timer: %u counts per ms\n", lapic_timer_khz);
+}
+
 void
 lapic_init(void)
 {
@@ -65,13 +92,15 @@ lapic_init(void)
 	// Enable local APIC; set spurious interrupt vector.
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
 
-	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// The timer counts down at bus frequency from lapic[TICR] and
+	// then issues an interrupt.  It runs one-shot: the scheduler
+	// arms it for the end of each timeslice, and an idle CPU leaves
+	// it stopped.  See lapic_timer_oneshot.
 	lapicw(TDCR, X1);
-	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	if (!lapic_timer_khz)
+		lapic_calibrate();
+	lapicw(TIMER, ONESHOT | (IRQ_OFFSET + IRQ_TIMER));
+	lapicw(TICR, 0);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -127,6 +156,31 @@ lapic_eoi(void)
 		lapicw(EOI, 0);
 }
 
+// Interrupt this CPU with IRQ_TIMER in 'msec' milliseconds, or as soon
+// as possible if 'msec' is 0.  This replaces whatever was armed before.
+// Deadlines further off than the timer can count fire early.
+void
+lapic_timer_oneshot(unsigned msec)
+{
+	uint32_t count;
+
+	if (!lapic)
+		return;
+	if (msec > 0xffffffff / lapic_timer_khz)
+		msec = 0xffffffff / lapic_timer_khz;
+	count = msec * lapic_timer_khz;
+	lapicw(TICR, count ? count : 1);
+}
+
+// Stop this CPU's timer, so that it takes no more timer interrupts
+// until it is armed again.
+void
+lapic_timer_stop(void)
+{
+	if (lapic)
+		lapicw(TICR, 0);
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 static void
@@ -134,8 +188,6 @@ microdelay(int us)
 {
 }
 
-#define IO_RTC  0x70
-
 // Start additional processor running entry code at addr.
 // See Appendix B of MultiProcessor Specification.
 void
@@ -173,6 +225,16 @@ lapic_startap(uint8_t apicid, uint32_t addr)
 	}
 }
 
+// Send interrupt 'vector' to the CPU with local APIC ID 'apicid'.
+void
+lapic_ipi_cpu(uint8_t apicid, int vector)
+{
+	lapicw(ICRHI, apicid << 24);
+	lapicw(ICRLO, FIXED | vector);
+	while (lapic[ICRLO] & DELIVS)
+		;
+}
+
 void
 lapic_ipi(int vector)
 {
@@ -11,6 +11,7 @@
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/env.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -25,6 +26,7 @@ struct Command {
 static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
+	{ "top", "Display what environments have used; 'top envid' for one", mon_top },
 };
 
 /***** Implementations of basic kernel monitor commands *****/
@@ -63,6 +65,95 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 }
 
 
+static const char *const env_status_name[] = {
+	[ENV_FREE] = "free",
+	[ENV_DYING] = "dying",
+	[ENV_RUNNABLE] = "runnable",
+	[ENV_RUNNING] = "running",
+	[ENV_NOT_RUNNABLE] = "blocked",
+};
+
+static uint32_t
+total_syscalls(const struct EnvStats *es)
+{
+	uint32_t n = 0;
+	int i;
+
+	for (i = 0; i < NSYSCALLS; i++)
+		n += es->es_syscalls[i];
+	return n;
+}
+
+// Every counter of one environment, including its system calls by
+// number.
+static int
+top_env(envid_t envid)
+{
+	struct Env *e = &envs[ENVX(envid)];
+	struct EnvStats *es = e->env_stats;
+	int i;
+
+	if (es->es_id != envid || envid == 0) {
+		cprintf("No counters for environment %08x\n", envid);
+		return 0;
+	}
+	cprintf("env %08x: %s, weight %u, cpus %x, last cpu %d\n",
+		envid, e->env_id == envid ? env_status_name[e->env_status] : "exited",
+		e->env_weight, e->env_affinity, e->env_cpunum);
+	cprintf("  runs %u, ticks %u, user cycles %llu\n",
+		es->es_runs, es->es_ticks, es->es_cycles);
+	cprintf("  page faults %u, pages mapped %u\n",
+		es->es_pgfaults, es->es_pages);
+	cprintf("  ipc sent %u, received %u\n",
+		es->es_ipc_sent, es->es_ipc_recv);
+	cprintf("  syscalls %u:", total_syscalls(es));
+	for (i = 0; i < NSYSCALLS; i++)
+		if (es->es_syscalls[i])
+			cprintf(" %d:%u", i, es->es_syscalls[i]);
+	cprintf("\n");
+	return 0;
+}
+
+// One line per environment, the busiest first.
+int
+mon_top(int argc, char **argv, struct Trapframe *tf)
+{
+	static struct Env *order[NENV];
+	struct EnvStats *es;
+	struct Env *e;
+	int i, j, n = 0;
+
+	if (argc > 1)
+		return top_env(strtol(argv[1], NULL, 16));
+
+	for (e = envs; e < envs + NENV; e++) {
+		if (e->env_status == ENV_FREE)
+			continue;
+		// Insertion sort by user cycles
+		for (j = n++; j > 0; j--) {
+			if (order[j - 1]->env_stats->es_cycles
+			    >= e->env_stats->es_cycles)
+				break;
+			order[j] = order[j - 1];
+		}
+		order[j] = e;
+	}
+
+	cprintf("   envid status    wt cpu    runs   ticks  Mcycles"
+		" syscalls  faults ipc-sent ipc-recv  pages\n");
+	for (i = 0; i < n; i++) {
+		e = order[i];
+		es = e->env_stats;
+		cprintf("%08x %-8s %4u %3d %7u %7u %8u %8u %7u %8u %8u %6u\n",
+			e->env_id, env_status_name[e->env_status],
+			e->env_weight, e->env_cpunum, es->es_runs,
+			es->es_ticks, (uint32_t) (es->es_cycles / 1000000),
+			total_syscalls(es), es->es_pgfaults, es->es_ipc_sent,
+			es->es_ipc_recv, es->es_pages);
+	}
+	return 0;
+}
+
 
 /***** Kernel monitor command interpreter *****/
 
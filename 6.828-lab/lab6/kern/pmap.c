@@ -85,7 +85,7 @@ static void check_page_installed_pgdir(void);
 // This function may ONLY be used during initialization,
 // before the page_free_list list has been set up.
 // Note that when this function is called, we are still using entry_pgdir,
-// which only maps the first 4MB of physical memory.
+// which only maps the first 8MB of physical memory.
 static void *
 boot_alloc(uint32_t n)
 {
@@ -168,6 +168,8 @@ mem_init(void)
 	// LAB 3: Your code here.
 	envs = (struct Env*) boot_alloc(NENV * sizeof(struct Env));
 	memset(envs,0, NENV* sizeof (struct Env));
+	envstats = (struct EnvStats *) boot_alloc(NENV * sizeof(struct EnvStats));
+	memset(envstats, 0, NENV * sizeof(struct EnvStats));
 	//////////////////////////////////////////////////////////////////////
 	// Now that we've allocated the initial kernel data structures, we set
 	// up the list of free physical pages. Once we've done so, all further
@@ -198,7 +200,16 @@ mem_init(void)
 	//    - the new image at UENVS  -- kernel R, user R
 	//    - envs itself -- kernel RW, user NONE
 	// LAB 3: Your code here.
-	boot_map_region(kern_pgdir,UENVS,PTSIZE,PADDR(envs),PTE_U | PTE_P);
+	// Only as much as envs takes, leaving room for the counters at
+	// USTATS and the clock page at UCLOCK (kern/time.c).
+	static_assert(NENV*sizeof(struct Env) <= USTATS - UENVS);
+	boot_map_region(kern_pgdir,UENVS,ROUNDUP(NENV*sizeof(struct Env), PGSIZE),
+			PADDR(envs),PTE_U | PTE_P);
+	// Likewise the 'envstats' array at USTATS
+	static_assert(NENV*sizeof(struct EnvStats) <= UCLOCK - USTATS);
+	boot_map_region(kern_pgdir, USTATS,
+			ROUNDUP(NENV*sizeof(struct EnvStats), PGSIZE),
+			PADDR(envstats), PTE_U | PTE_P);
 	//////////////////////////////////////////////////////////////////////
 	// Use the physical memory that 'bootstack' refers to as the kernel
 	// stack.  The kernel stack grows down from virtual address KSTACKTOP.
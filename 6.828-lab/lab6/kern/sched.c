@@ -1,84 +1,246 @@
 #include <inc/assert.h>
 #include <inc/x86.h>
+#include <inc/error.h>
 #include <kern/spinlock.h>
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/sched.h>
+#include <kern/cpu.h>
+#include <kern/time.h>
 
-void sched_halt(void);
+void sched_halt(void) __attribute__((noreturn));
+
+static unsigned slice_msec = SCHED_SLICE_MSEC;
+
+// Stride scheduling.  Each environment has a pass, which advances by
+// its stride, STRIDE1 / env_weight, for every full timeslice of CPU
+// time it uses, and in proportion for less; the runnable environment
+// with the lowest pass runs next.  Over time each one gets CPU in
+// proportion to its weight.  One that blocks early in its timeslice is
+// only charged for what it used, but one that yields gives up the rest
+// of its timeslice and is charged for all of it.
+//
+// global_pass is the pass of the environment chosen last, which is the
+// scheduler's notion of the present.  An environment that wakes up
+// after blocking starts from there, so it gets no credit for the time
+// it spent asleep but does run ahead of anyone who has used more than
+// their share.  The servers block most of the time, and have a high
+// weight, so their requests are served ahead of batch work.
+#define STRIDE1		(1 << 20)
+
+static uint64_t global_pass;
+
+// The environment each CPU last dispatched, with its pass and the
+// cycles it had used when it was dispatched.
+static struct {
+	struct Env *env;
+	uint64_t pass;
+	uint64_t cycles;
+} dispatched[NCPU];
+
+// Moving to another CPU costs an environment the cache and TLB state it
+// built up on its last one.  One that last ran elsewhere is chosen as
+// though its pass were higher by half a timeslice at the default
+// weight, so it only moves once it has fallen that far behind.
+#define MIGRATE_PASS	(STRIDE1 / ENV_WEIGHT_DEFAULT / 2)
+
+// e's pass, as far as this CPU is concerned.
+static uint64_t
+local_pass(struct Env *e)
+{
+	if (e->env_runs > 0 && e->env_cpunum != cpunum())
+		return e->env_pass + MIGRATE_PASS;
+	return e->env_pass;
+}
+
+// Run 'e' for a timeslice: arm this CPU's timer for its end, or for
+// the next receive deadline if that comes first.
+static void
+sched_run(struct Env *e)
+{
+	global_pass = e->env_pass;
+	e->env_stats->es_runs++;
+	dispatched[cpunum()].env = e;
+	dispatched[cpunum()].pass = e->env_pass;
+	dispatched[cpunum()].cycles = e->env_stats->es_cycles;
+	lapic_timer_oneshot(MIN(slice_msec, time_next_deadline()));
+	env_run(e);
+}
+
+// Advance the pass of 'e', which this CPU is running, by the CPU time it
+// has used since it was dispatched, as counted in es_cycles.  Working
+// from the dispatch keeps the rounding down to once per timeslice.
+void
+sched_charge(struct Env *e)
+{
+	uint64_t used, slice;
+
+	if (dispatched[cpunum()].env != e)
+		return;
+	used = e->env_stats->es_cycles - dispatched[cpunum()].cycles;
+	slice = (uint64_t) slice_msec * time_tsc_khz();
+	e->env_pass = dispatched[cpunum()].pass
+		+ used * STRIDE1 / (slice * e->env_weight);
+}
+
+// 'e', which this CPU is running, gives up the rest of its timeslice:
+// charge it for all of it.
+void
+sched_forfeit(struct Env *e)
+{
+	uint64_t pass;
+
+	if (dispatched[cpunum()].env != e)
+		return;
+	pass = dispatched[cpunum()].pass + STRIDE1 / e->env_weight;
+	if (e->env_pass < pass)
+		e->env_pass = pass;
+}
 
 // Choose a user environment to run and run it.
 void
 sched_yield(void)
 {
-	struct Env *idle;
+	struct Env *e, *best = NULL;
+	uint32_t me = 1 << cpunum();
+	uint64_t best_pass = 0;
+	int i, start;
 
-	// Implement simple round-robin scheduling.
-	//
-	// Search through 'envs' for an ENV_RUNNABLE environment in
-	// circular fashion starting just after the env this CPU was
-	// last running.  Switch to the first such environment found.
-	//
-	// If no envs are runnable, but the environment previously
-	// running on this CPU is still ENV_RUNNING, it's okay to
-	// choose that environment. Make sure curenv is not null before
-	// dereferencing it.
+	// Pick the ENV_RUNNABLE environment allowed on this CPU with the
+	// lowest local_pass.  The search starts just after the env this
+	// CPU was last running, so that environments with equal passes
+	// take turns.
 	//
+	// The environment previously running on this CPU may continue
+	// if it is still ENV_RUNNING and nothing else has a lower pass.
 	// Never choose an environment that's currently running on
 	// another CPU (env_status == ENV_RUNNING). If there are
 	// no runnable environments, simply drop through to the code
 	// below to halt the cpu.
-
-	// LAB 4: Your code here.
-	// cprintf("enter yield");
-	struct Env* current_proc = thiscpu->cpu_env; //当前cpu正在运行的进程
-	int startid = (current_proc) ? ENVX(current_proc->env_id) : 0; //返回在当前CPU运行的进程ID
-	int next_procid;
-	for(int i = 0; i < NENV; i++) {
-		// 找到当前进城之后第一个状态为RUNNABLE的进程
-		next_procid = (startid+i) % NENV;
-		if(envs[next_procid].env_status == ENV_RUNNABLE) {
-			env_run(&envs[next_procid]); //运行新的进程
+	start = curenv ? ENVX(curenv->env_id) + 1 : 0;
+	for (i = 0; i < NENV; i++) {
+		e = &envs[(start + i) % NENV];
+		if (e->env_status == ENV_RUNNABLE && (e->env_affinity & me)
+		    && (!best || local_pass(e) < best_pass)) {
+			best = e;
+			best_pass = local_pass(e);
 		}
 	}
+	if (curenv && curenv->env_status == ENV_RUNNING
+	    && curenv->env_cpunum == cpunum()) {
+		if (!(curenv->env_affinity & me)) {
+			// Its affinity changed; hand it to a CPU it may use
+			curenv->env_status = ENV_RUNNABLE;
+			sched_wake(curenv);
+		} else if (!best || curenv->env_pass < best_pass)
+			best = curenv;
+	}
+	if (best)
+		sched_run(best);
+	sched_halt();
+}
 
-	//注释里面说到了，不能将当前正在运行的进程运行到别的CPU上。如果之前运行在当前CPU的进程仍然在运行
-	//且没有其他可以runnable的进程，那么就继续运行原来的进程
-	if(envs[startid].env_status == ENV_RUNNING && envs[startid].env_cpunum == cpunum()) {
-		env_run(current_proc); //继续运行原来的进程
+// Environment 'e' has just become runnable.  Idle CPUs take no timer
+// interrupts, so if one that 'e' may run on is halted, interrupt it to
+// come and run it; the CPU 'e' last ran on if possible.
+void
+sched_wake(struct Env *e)
+{
+	struct CpuInfo *c;
+
+	if (e->env_pass < global_pass)
+		e->env_pass = global_pass;
+
+	c = &cpus[e->env_cpunum];
+	if (e->env_runs > 0 && c != thiscpu && c->cpu_status == CPU_HALTED
+	    && (e->env_affinity & (1 << c->cpu_id))) {
+		lapic_ipi_cpu(c->cpu_id, IRQ_OFFSET + IRQ_WAKEUP);
+		return;
 	}
-    sched_halt();
+	for (c = cpus; c < cpus + ncpu; c++)
+		if (c != thiscpu && c->cpu_status == CPU_HALTED
+		    && (e->env_affinity & (1 << c->cpu_id))) {
+			lapic_ipi_cpu(c->cpu_id, IRQ_OFFSET + IRQ_WAKEUP);
+			return;
+		}
 }
 
-// Halt this CPU when there is nothing to do. Wait until the
-// timer interrupt wakes it up. This function never returns.
+// Let 'e' run only on the CPUs in 'mask', bit i standing for cpus[i].
+// Bits for CPUs that do not exist are dropped.  If 'e' is running on a
+// CPU it may no longer use, it moves at the end of its timeslice.
+int
+sched_set_affinity(struct Env *e, uint32_t mask)
+{
+	mask &= (ncpu < 32 ? (1U << ncpu) : 0) - 1;
+	if (!mask)
+		return -E_INVAL;
+	e->env_affinity = mask;
+	return 0;
+}
+
+// Give 'e' a share of the CPU proportional to 'weight'.  Only the
+// servers may raise a weight; other callers may only lower one.
+int
+sched_set_weight(struct Env *e, unsigned weight)
+{
+	if (weight < ENV_WEIGHT_MIN || weight > ENV_WEIGHT_MAX)
+		return -E_INVAL;
+	if (weight > e->env_weight && curenv->env_type == ENV_TYPE_USER)
+		return -E_BAD_ENV;
+	e->env_weight = weight;
+	return 0;
+}
+
+// Set the timeslice to 'msec' milliseconds, from the next one on.
+int
+sched_set_slice(unsigned msec)
+{
+	if (msec == 0 || msec > 1000)
+		return -E_INVAL;
+	slice_msec = msec;
+	return 0;
+}
+
+// Halt this CPU when there is nothing to do.  Its timer is stopped,
+// unless an environment is waiting for a receive deadline, so it
+// sleeps until sched_wake or a device interrupt wakes it up.
+// This function never returns.
 //
 void
 sched_halt(void)
 {
+	unsigned deadline;
 	int i;
 
 	// For debugging and testing purposes, if there are no runnable
-	// environments in the system, then drop into the kernel monitor.
+	// environments in the system, and none waiting for a deadline,
+	// then drop into the kernel monitor.
 	for (i = 0; i < NENV; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
 		     envs[i].env_status == ENV_DYING))
 			break;
 	}
-	if (i == NENV) {
+	deadline = time_next_deadline();
+	if (i == NENV && deadline == ~0U) {
 		cprintf("No runnable environments in the system!\n");
 		while (1)
 			monitor(NULL);
 	}
 
+	if (deadline == ~0U)
+		lapic_timer_stop();
+	else
+		lapic_timer_oneshot(deadline);
+
 	// Mark that no environment is running on this CPU
 	curenv = NULL;
 	lcr3(PADDR(kern_pgdir));
 
 	// Mark that this CPU is in the HALT state, so that when
-	// timer interupts come in, we know we should re-acquire the
-	// big kernel lock
+	// interrupts come in, we know we should re-acquire the
+	// big kernel lock, and so that sched_wake finds us
 	xchg(&thiscpu->cpu_status, CPU_HALTED);
 
 	// Release the big kernel lock as if we were "leaving" the kernel
@@ -96,5 +258,6 @@ sched_halt(void)
 		"hlt\n"
 		"jmp 1b\n"
 	: : "a" (thiscpu->cpu_ts.ts_esp0));
+	__builtin_unreachable();
 }
 
@@ -6,7 +6,20 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+// How long an environment runs before the timer preempts it, in ms.
+// Override with KERN_CFLAGS or at run time with sys_sched_set_slice.
+#ifndef SCHED_SLICE_MSEC
+#define SCHED_SLICE_MSEC	10
+#endif
+
 // This function does not return.
 void sched_yield(void) __attribute__((noreturn));
+struct Env;
+void sched_wake(struct Env *e);
+void sched_charge(struct Env *e);
+void sched_forfeit(struct Env *e);
+int sched_set_weight(struct Env *e, unsigned weight);
+int sched_set_affinity(struct Env *e, uint32_t mask);
+int sched_set_slice(unsigned msec);
 
 #endif	// !JOS_KERN_SCHED_H
@@ -12,6 +12,7 @@
 #include <kern/console.h>
 #include <kern/sched.h>
 #include <kern/time.h>
+#include <kern/e1000.h>
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
@@ -64,6 +65,7 @@ sys_env_destroy(envid_t envid)
 static void
 sys_yield(void)
 {
+	sched_forfeit(curenv);
 	sched_yield();
 }
 
@@ -90,6 +92,12 @@ sys_exofork(void)
 	}
 	child->env_status = ENV_NOT_RUNNABLE;
 	child->env_tf = curenv->env_tf;
+	child->env_weight = curenv->env_weight;
+	child->env_affinity = curenv->env_affinity;
+	if ((ret_value = env_fpu_fork(child, curenv)) < 0) {
+		env_free(child);
+		return ret_value;
+	}
 	// cprintf("ip:%x\n",curenv->env_tf.tf_eip);
 	child->env_tf.tf_regs.reg_eax = 0;
 	return child->env_id;
@@ -122,6 +130,8 @@ sys_env_set_status(envid_t envid, int status)
 		return -E_INVAL;
 	}
 	proc->env_status = status;
+	if (status == ENV_RUNNABLE)
+		sched_wake(proc);
 	return 0;
 	// panic("sys_env_set_status not implemented");
 }
@@ -233,7 +243,7 @@ sys_page_alloc(envid_t envid, void *va, int perm)
 	if(new_page == NULL) {
 		return -E_NO_MEM;
 	}
-	if( (ret_value = page_insert(env->env_pgdir,new_page,va,perm)) < 0) {
+	if( (ret_value = env_page_insert(env,new_page,va,perm)) < 0) {
 		page_free(new_page);
 		return ret_value;
 	}
@@ -297,7 +307,7 @@ sys_page_map(envid_t srcenvid, void *srcva,
 		return -E_INVAL;
 	}
 	// return -E_NO_MEM if there's no memory to allocate any necessary page tables
-	if(page_insert(dst_env->env_pgdir,page,dstva,perm) < 0) {
+	if(env_page_insert(dst_env,page,dstva,perm) < 0) {
 		return -E_NO_MEM ;
 	}
 	return 0;
@@ -325,7 +335,7 @@ sys_page_unmap(envid_t envid, void *va)
 	if( (uintptr_t)va >= UTOP || PGOFF(va)) {
 		return -E_INVAL;
 	}
-	page_remove(env->env_pgdir,va);
+	env_page_remove(env,va);
 	return 0;
 	// panic("sys_page_unmap not implemented");
 }
@@ -384,6 +394,8 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 		// 说明target process并不想接收数据，所以return -E_IPC_NOT_RECV;
 		return -E_IPC_NOT_RECV;
 	}
+	// perm stays 0 unless a page is actually transferred
+	proc->env_ipc_perm = 0;
 	if(src_addr < UTOP) {
 		if (PGOFF(srcva) > 0) {
 			//not page-aligned
@@ -406,11 +418,11 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 			//所以如果我们要判断它是否是一个read-only的，只需要！即可
             return -E_INVAL;
 		} 
-		if(proc->env_ipc_dstva) {
+		if((uint32_t)proc->env_ipc_dstva < UTOP) {
 			// 如果src_addr < UTOP,才可以使用页来传递数据
 			//接下来要做的在目标进程插入页,这样就完成了页的共享.
 			//proc->env_ipc_dstva是进程自己设置好的,它表明期望将数据接受到哪里
-			result = page_insert(proc->env_pgdir, page, proc->env_ipc_dstva, perm);
+			result = env_page_insert(proc, page, proc->env_ipc_dstva, perm);
 			if(result < 0) {
 				//no avaiable memory 
 				return -E_NO_MEM;
@@ -419,9 +431,14 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 		}
 	}
 	proc->env_ipc_recving = 0; //表示接受完毕
+	time_cancel_timeout(proc);
+	proc->env_tf.tf_regs.reg_eax = 0;
 	proc->env_ipc_value = value;
 	proc->env_ipc_from = curenv->env_id;
+	curenv->env_stats->es_ipc_sent++;
+	proc->env_stats->es_ipc_recv++;
 	proc->env_status = ENV_RUNNABLE; //接收数据完毕后设置为RUNNABLE，接受调度
+	sched_wake(proc);
 	return 0;
 }
 
@@ -454,12 +471,200 @@ sys_ipc_recv(void *dstva)
     // return 0;
 }
 
+// Like sys_ipc_recv, but give up after 'msec' milliseconds, counted in
+// timer ticks.  The deadline lives in kern/time.c and is checked on
+// the timer interrupt, so a waiting environment costs nothing until
+// a message arrives or its time is up.
+//
+// Returns -E_TIMEOUT when the time runs out (immediately if 'msec' is
+// 0), -E_INVAL if 'msec' is too large to compare deadlines with, and
+// otherwise as sys_ipc_recv.
+static int
+sys_ipc_recv_timeout(void *dstva, unsigned int msec)
+{
+	if ((uint32_t) dstva < UTOP && PGOFF(dstva))
+		return -E_INVAL;
+	if (msec == 0)
+		return -E_TIMEOUT;
+	if (msec > 0x7fffffff)
+		return -E_INVAL;
+	time_add_timeout(curenv, msec);
+	curenv->env_ipc_recving = 1;
+	curenv->env_ipc_dstva = dstva;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_yield();
+}
+
 // Return the current time.
 static int
 sys_time_msec(void)
 {
 	// LAB 6: Your code here.
-	panic("sys_time_msec not implemented");
+	return time_msec();
+}
+
+// Transmit one Ethernet frame of 'len' bytes from 'buf'.
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_AGAIN if the transmit ring is full.
+//	-E_INVAL if the frame is too large.
+static int
+sys_net_transmit(const void *buf, size_t len)
+{
+	user_mem_assert(curenv, buf, len, PTE_U);
+	return e1000_transmit(buf, len);
+}
+
+// Transmit up to 'n' frames, the i'th being lens[i] bytes at bufs[i],
+// with a single doorbell write to the card.  At most a ring's worth
+// are taken at a time.
+// Returns the number of frames queued, or < 0 on error.  Errors are:
+//	-E_AGAIN if the transmit ring is full.
+//	-E_INVAL if 'n' is negative or the first frame is too large.
+static int
+sys_net_transmit_batch(const void *const *ubufs, const size_t *ulens, int n)
+{
+	const void *bufs[E1000_NTXDESC];
+	size_t lens[E1000_NTXDESC];
+	int i;
+
+	if (n < 0)
+		return -E_INVAL;
+	n = MIN(n, E1000_NTXDESC);
+	user_mem_assert(curenv, ubufs, n * sizeof(ubufs[0]), PTE_U);
+	user_mem_assert(curenv, ulens, n * sizeof(ulens[0]), PTE_U);
+	// Fetch the arrays once: another thread of the caller could change
+	// them between the checks below and the driver's use
+	memmove(bufs, ubufs, n * sizeof(bufs[0]));
+	memmove(lens, ulens, n * sizeof(lens[0]));
+	for (i = 0; i < n; i++)
+		user_mem_assert(curenv, bufs[i], lens[i], PTE_U);
+	return e1000_transmit_batch(bufs, lens, n);
+}
+
+// Receive one Ethernet frame into 'buf', which holds 'len' bytes.
+// Returns the frame's length, or < 0 on error.  Errors are:
+//	-E_AGAIN if no frame has arrived.
+//	-E_INVAL if 'buf' is too small for the frame.
+static int
+sys_net_receive(void *buf, size_t len)
+{
+	user_mem_assert(curenv, buf, len, PTE_U|PTE_W);
+	return e1000_receive(buf, len);
+}
+
+// Receive one Ethernet frame without copying it.  The page mapped at
+// 'va' goes to the card for a later frame, and the page the frame
+// arrived in is mapped at 'va' in its place, with the frame starting
+// E1000_RXPAGE_OFF bytes in (where struct jif_pkt's jp_data is).
+// Returns the frame's length, or < 0 on error.  Errors are:
+//	-E_AGAIN if no frame has arrived.
+//	-E_INVAL if va >= UTOP, or va is not page-aligned, or no
+//		writable page is mapped there, or that page is shared
+//		(the card would overwrite it under its other users).
+static int
+sys_net_receive_page(void *va)
+{
+	struct PageInfo *empty, *full;
+	pte_t *pte;
+	int r;
+
+	if ((uintptr_t) va >= UTOP || PGOFF(va))
+		return -E_INVAL;
+	empty = page_lookup(curenv->env_pgdir, va, &pte);
+	if (!empty || (*pte & (PTE_U|PTE_W)) != (PTE_U|PTE_W) || empty->pp_ref != 1)
+		return -E_INVAL;
+
+	if ((r = e1000_receive_page(empty, &full)) < 0)
+		return r;
+	// va already has a page table, so this cannot fail
+	page_insert(curenv->env_pgdir, full, va, PTE_P|PTE_U|PTE_W);
+	page_decref(full);
+	return r;
+}
+
+// Block until a frame may have arrived in the receive ring.
+// Returns 0, or -E_NOT_SUPP if the card has no receive interrupts, in
+// which case the caller has to poll.
+static int
+sys_net_wait_receive(void)
+{
+	int r;
+
+	if ((r = e1000_wait_receive(curenv->env_id)) <= 0)
+		return r;
+	// e1000_intr sets our return value when it wakes us
+	sched_yield();
+}
+
+// Set the card's receive interrupt moderation: 'itr' is the minimum
+// interval between interrupts in 256ns units, 'rdtr' the delay after
+// each frame and 'radv' the absolute delay, in 1.024us units.
+// Returns 0, or -E_INVAL if a value is out of range.
+static int
+sys_net_set_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv)
+{
+	return e1000_set_moderation(itr, rdtr, radv);
+}
+
+// Set envid's scheduling weight: while it wants to run, it gets CPU
+// time in proportion to 'weight' among the others that do.  A child
+// inherits its parent's weight.  Only the servers may raise a weight.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid,
+//		or the caller is not a server and 'weight' is higher
+//		than envid's current one.
+//	-E_INVAL if weight is not between ENV_WEIGHT_MIN and ENV_WEIGHT_MAX.
+static int
+sys_env_set_weight(envid_t envid, unsigned weight)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	return sched_set_weight(e, weight);
+}
+
+// Let envid run only on the CPUs in 'mask', where bit i stands for the
+// CPU whose cpunum() is i.  Servers can be given CPUs of their own this
+// way.  A child inherits its parent's affinity.  If the caller excludes
+// the CPU it is running on, it moves before this returns; another
+// environment moves at the end of its timeslice.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if 'mask' names none of the CPUs there are.
+static int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if ((r = sched_set_affinity(e, mask)) < 0)
+		return r;
+	if (e == curenv && !(e->env_affinity & (1 << cpunum()))) {
+		curenv->env_tf.tf_regs.reg_eax = 0;
+		sched_yield();
+	}
+	return 0;
+}
+
+// Set the scheduler's timeslice to 'msec' milliseconds.  This applies
+// to every environment, so only the servers may change it.
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if the caller is not a server.
+//	-E_INVAL if 'msec' is 0 or more than a second.
+static int
+sys_sched_set_slice(unsigned msec)
+{
+	if (curenv->env_type == ENV_TYPE_USER)
+		return -E_BAD_ENV;
+	return sched_set_slice(msec);
 }
 
 // Dispatches to the correct kernel function, passing the arguments.
@@ -470,6 +675,8 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	// Call the function corresponding to the 'syscallno' parameter.
 	// Return any appropriate return value.
 	// LAB 3: Your code here.
+	if (syscallno < NSYSCALLS)
+		curenv->env_stats->es_syscalls[syscallno]++;
 	switch (syscallno) {
 	case SYS_cputs:
 		sys_cputs((char *)a1, a2);
@@ -499,8 +706,30 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		return sys_ipc_try_send((envid_t)a1, (uint32_t)a2, (void *)a3, (unsigned)a4);
 	case SYS_ipc_recv:
 		return sys_ipc_recv((void *)a1);
+	case SYS_ipc_recv_timeout:
+		return sys_ipc_recv_timeout((void *)a1, a2);
 	case SYS_env_set_trapframe:
 		return sys_env_set_trapframe((envid_t)a1,(struct Trapframe*)a2);		
+	case SYS_time_msec:
+		return sys_time_msec();
+	case SYS_net_transmit:
+		return sys_net_transmit((const void *)a1, (size_t)a2);
+	case SYS_net_transmit_batch:
+		return sys_net_transmit_batch((const void *const *)a1, (const size_t *)a2, (int)a3);
+	case SYS_net_receive:
+		return sys_net_receive((void *)a1, (size_t)a2);
+	case SYS_net_receive_page:
+		return sys_net_receive_page((void *)a1);
+	case SYS_net_wait_receive:
+		return sys_net_wait_receive();
+	case SYS_net_set_moderation:
+		return sys_net_set_moderation(a1, a2, a3);
+	case SYS_env_set_weight:
+		return sys_env_set_weight(a1, a2);
+	case SYS_env_set_affinity:
+		return sys_env_set_affinity(a1, a2);
+	case SYS_sched_set_slice:
+		return sys_sched_set_slice(a1);
 	default:
 		return -E_INVAL;
 }
@@ -1,26 +1,138 @@
 #include <kern/time.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/kclock.h>
+#include <kern/sched.h>
 #include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/x86.h>
 
-static unsigned int ticks;
+// Time is counted by the TSC, which keeps running when every CPU is
+// idle and its timer stopped.
+static uint64_t tsc_boot;	// TSC at time 0
+static uint32_t tsc_khz;	// TSC cycles per millisecond
+
+// How long to measure the TSC for, in ms
+#define CALIBRATE_MSEC	10
+
+// The clock page, mapped read-only for everyone at UCLOCK
+static struct Clock *clock;
+
+// Environments blocked in sys_ipc_recv_timeout, soonest deadline first
+static struct Env *timeouts;
 
 void
 time_init(void)
 {
-	ticks = 0;
+	struct PageInfo *pp;
+	uint64_t tsc;
+
+	// Calibrate the TSC against the PIT
+	tsc = read_tsc();
+	pit_delay(CALIBRATE_MSEC);
+	tsc_boot = read_tsc();
+	tsc_khz = (tsc_boot - tsc) / CALIBRATE_MSEC;
+	if (!tsc_khz)
+		panic("time_init: the TSC does not run");
+	cprintf("TSC: %u kHz\n", tsc_khz);
+
+	// The page tables above UTOP are shared by every environment, so
+	// this is mapped for them all from now on
+	if (!(pp = page_alloc(ALLOC_ZERO)))
+		panic("time_init: out of memory");
+	if (page_insert(kern_pgdir, pp, (void *) UCLOCK, PTE_U) < 0)
+		panic("time_init: cannot map the clock page");
+	clock = page2kva(pp);
+	clock->clk_tsc_boot = tsc_boot;
+	clock->clk_tsc_khz = tsc_khz;
+}
+
+// Wake every environment whose receive deadline has passed.  Its
+// sys_ipc_recv_timeout returns -E_TIMEOUT.
+static void
+time_expire(void)
+{
+	struct Env *e;
+
+	while ((e = timeouts) && (int) (e->env_ipc_deadline - time_msec()) <= 0) {
+		timeouts = e->env_timeout_link;
+		e->env_timeout_link = NULL;
+		e->env_ipc_timed = 0;
+		e->env_ipc_recving = 0;
+		e->env_tf.tf_regs.reg_eax = -E_TIMEOUT;
+		e->env_status = ENV_RUNNABLE;
+		sched_wake(e);
+	}
 }
 
-// This should be called once per timer interrupt.  A timer interrupt
-// fires every 10 ms.
+// This should be called on every timer interrupt, on any CPU.  The
+// timers are one-shot, armed by the scheduler for the end of a
+// timeslice or for time_next_deadline, whichever comes first.
 void
 time_tick(void)
 {
-	ticks++;
-	if (ticks * 10 < ticks)
-		panic("time_tick: time overflowed");
+	time_expire();
 }
 
+// TSC cycles per millisecond
+unsigned int
+time_tsc_khz(void)
+{
+	return tsc_khz;
+}
+
+// Milliseconds since boot.  This wraps after 49 days, so compare
+// times by their signed difference.
 unsigned int
 time_msec(void)
 {
-	return ticks * 10;
+	return (read_tsc() - tsc_boot) / tsc_khz;
+}
+
+// Milliseconds until the soonest receive deadline, 0 if it has passed,
+// or ~0 if nobody is waiting for one.
+unsigned int
+time_next_deadline(void)
+{
+	int left;
+
+	if (!timeouts)
+		return ~0;
+	left = timeouts->env_ipc_deadline - time_msec();
+	return left > 0 ? left : 0;
+}
+
+// Give the receive 'e' is blocked in a deadline 'msec' milliseconds
+// from now.  The list is kept sorted, so the timer interrupt only ever
+// looks at its head; it is as long as the number of waiters.
+void
+time_add_timeout(struct Env *e, unsigned int msec)
+{
+	struct Env **pp;
+
+	time_cancel_timeout(e);
+	e->env_ipc_deadline = time_msec() + msec;
+	for (pp = &timeouts; *pp; pp = &(*pp)->env_timeout_link)
+		if ((int) ((*pp)->env_ipc_deadline - e->env_ipc_deadline) > 0)
+			break;
+	e->env_timeout_link = *pp;
+	*pp = e;
+	e->env_ipc_timed = 1;
+}
+
+// Forget e's deadline, if it has one.
+void
+time_cancel_timeout(struct Env *e)
+{
+	struct Env **pp;
+
+	if (!e->env_ipc_timed)
+		return;
+	for (pp = &timeouts; *pp; pp = &(*pp)->env_timeout_link)
+		if (*pp == e) {
+			*pp = e->env_timeout_link;
+			break;
+		}
+	e->env_timeout_link = NULL;
+	e->env_ipc_timed = 0;
 }
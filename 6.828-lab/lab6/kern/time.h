@@ -7,5 +7,11 @@
 void time_init(void);
 void time_tick(void);
 unsigned int time_msec(void);
+unsigned int time_tsc_khz(void);
+unsigned int time_next_deadline(void);
+
+struct Env;
+void time_add_timeout(struct Env *e, unsigned int msec);
+void time_cancel_timeout(struct Env *e);
 
 #endif /* JOS_KERN_TIME_H */
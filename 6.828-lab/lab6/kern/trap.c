@@ -1,6 +1,7 @@
 #include <inc/mmu.h>
 #include <inc/x86.h>
 #include <inc/assert.h>
+#include <inc/string.h>
 
 #include <kern/pmap.h>
 #include <kern/trap.h>
@@ -14,6 +15,7 @@
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
 #include <kern/time.h>
+#include <kern/e1000.h>
 
 static struct Taskstate ts;
 
@@ -98,8 +100,10 @@ trap_init(void)
 	void kbd_handler();
 	void serial_handler();
 	void spurious_handler();
+	void e1000_handler();
 	void ide_handler();
 	void error_handler();
+	void wakeup_handler();
 	
 
 	// LAB 3: Your code here.
@@ -129,8 +133,10 @@ trap_init(void)
     SETGATE(idt[IRQ_OFFSET + IRQ_KBD],      0, GD_KT, kbd_handler,     0);
     SETGATE(idt[IRQ_OFFSET + IRQ_SERIAL],   0, GD_KT, serial_handler,  0);
     SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, GD_KT, spurious_handler, 0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_E1000],    0, GD_KT, e1000_handler,   0);
     SETGATE(idt[IRQ_OFFSET + IRQ_IDE],      0, GD_KT, ide_handler,     0);
     SETGATE(idt[IRQ_OFFSET + IRQ_ERROR],    0, GD_KT, error_handler,   0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_WAKEUP],   0, GD_KT, wakeup_handler,  0);
 
 	// Per-CPU setup 
 	trap_init_percpu();
@@ -140,6 +146,9 @@ trap_init(void)
 void
 trap_init_percpu(void)
 {
+	void sysenter_handler();
+	uint32_t edx;
+
 	// The example code here sets up the Task State Segment (TSS) and
 	// the TSS descriptor for CPU 0. But it is incorrect if we are
 	// running on other CPUs because each CPU has its own kernel stack.
@@ -192,6 +201,17 @@ trap_init_percpu(void)
 
     // Load the IDT
     lidt(&idt_pd);
+
+	// SYSENTER enters at sysenter_handler on this CPU's kernel stack,
+	// with CS from the first MSR and SS from the next GDT entry.
+	// SYSEXIT returns with the two entries after that, so GD_KT,
+	// GD_KD, GD_UT and GD_UD must stay in that order.
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_EDX_SEP) {
+		wrmsr(MSR_IA32_SYSENTER_CS, GD_KT);
+		wrmsr(MSR_IA32_SYSENTER_ESP, thiscpu->cpu_ts.ts_esp0);
+		wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t) sysenter_handler);
+	}
 }
 
 void
@@ -272,6 +292,8 @@ trap_dispatch(struct Trapframe *tf)
 	int ret_value;
 	switch(tf->tf_trapno) {
 		case T_PGFLT:
+			if ((tf->tf_cs & 3) == 3)
+				curenv->env_stats->es_pgfaults++;
 			page_fault_handler(tf);
 			break;
 		case T_BRKPT:
@@ -287,9 +309,17 @@ trap_dispatch(struct Trapframe *tf)
 			tf->tf_regs.reg_eax = ret_value;
 			break;
 		case (IRQ_OFFSET + IRQ_TIMER):
+            // The end of a timeslice or a receive deadline.
+            if (curenv)
+                curenv->env_stats->es_ticks++;
+            time_tick();
             lapic_eoi();
             sched_yield();
             break;
+		case (IRQ_OFFSET + IRQ_WAKEUP):
+			// sched_wake: trap() schedules if this CPU was idle
+			lapic_eoi();
+			break;
 		case (IRQ_OFFSET + IRQ_KBD):
 			lapic_eoi();
 			kbd_intr();
@@ -298,6 +328,21 @@ trap_dispatch(struct Trapframe *tf)
 			lapic_eoi();
 			serial_intr();
 			break;
+		case (IRQ_OFFSET + IRQ_E1000):
+			// IRQ 11 comes through the slave 8259, which is not in
+			// automatic EOI mode, so acknowledge it there as well
+			irq_eoi();
+			lapic_eoi();
+			e1000_intr();
+			break;
+		case T_DEVICE:
+			// First FPU instruction since env_run set CR0_TS.
+			// If there is no memory for its registers, the
+			// environment is destroyed below.
+			if ((tf->tf_cs & 3) == 3 && !curenv->env_fpregs
+			    && env_fpu_trap(curenv) == 0)
+				break;
+			/* fall through */
 		default: 
 			// Unexpected trap: The user process or the kernel has a bug.
 			print_trapframe(tf);
@@ -354,6 +399,8 @@ trap(struct Trapframe *tf)
 		curenv->env_tf = *tf;
 		// The trapframe on the stack should be ignored from here on.
 		tf = &curenv->env_tf;
+		env_fpu_save(curenv);
+		env_charge(curenv);
 	}
 
 	// Record that tf is the last real trapframe so
@@ -373,6 +420,46 @@ trap(struct Trapframe *tf)
 		sched_yield();
 }
 
+// System calls that came in through sysenter_handler, with the
+// Trapframe it built on the kernel stack.  This skips the checks
+// and dispatch of trap().  It returns the Trapframe that
+// sysenter_handler should take back to user mode, unless the system
+// call moved on to another environment or rewrote the Trapframe.
+struct Trapframe *
+syscall_fast(struct Trapframe *tf)
+{
+	struct PushRegs *regs = &tf->tf_regs;
+	int32_t ret;
+
+	lock_kernel();
+	assert(curenv);
+	if (curenv->env_status == ENV_DYING) {
+		env_free(curenv);
+		curenv = NULL;
+		sched_yield();
+	}
+	// Save the frame in case the call blocks, forks or yields
+	curenv->env_tf = *tf;
+	env_fpu_save(curenv);
+	env_charge(curenv);
+
+	ret = syscall(regs->reg_eax, regs->reg_edx, regs->reg_ecx,
+		      regs->reg_ebx, 0, 0);
+	curenv->env_tf.tf_regs.reg_eax = ret;
+	if (curenv->env_status != ENV_RUNNING)
+		sched_yield();
+
+	// SYSEXIT cannot restore %ecx, %edx or the flags.  If the call
+	// rewrote more of our Trapframe than %eax, as
+	// sys_env_set_trapframe on ourselves does, go back with iret.
+	regs->reg_eax = ret;
+	if (memcmp(tf, &curenv->env_tf, sizeof(*tf)) != 0)
+		env_run(curenv);
+
+	unlock_kernel();
+	thiscpu->cpu_user_tsc = read_tsc();
+	return &curenv->env_tf;
+}
 
 void
 page_fault_handler(struct Trapframe *tf)
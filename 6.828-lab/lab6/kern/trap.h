@@ -18,6 +18,7 @@ void trap_init_percpu(void);
 void print_regs(struct PushRegs *regs);
 void print_trapframe(struct Trapframe *tf);
 void page_fault_handler(struct Trapframe *);
+struct Trapframe *syscall_fast(struct Trapframe *tf);
 void backtrace(struct Trapframe *);
 
 #endif /* JOS_KERN_TRAP_H */
@@ -0,0 +1,279 @@
+// Asynchronous read and write.
+//
+// aread() and awrite() start an operation on a file descriptor and
+// return an aio id at once; await_any() blocks until one of the
+// operations in flight is done and returns its id.
+//
+// Devices backed by a server (devfile, devsock) send each operation on
+// a request page of its own, flagged with IPCREQ_ASYNC, and the server
+// maps that page back along with its reply.  A reply may arrive while
+// we are waiting for some synchronous reply instead, so fsipc() and
+// nsipc() receive through aio_ipc_recv(), which recognizes the page
+// and records the completion.  Devices without a server (devpipe) are
+// polled from await_any(), and devices without dev_aread/dev_awrite
+// (devcons) are simply done synchronously.
+
+#include <inc/lib.h>
+
+#define debug		0
+
+// Maximum number of operations in flight at once
+#define MAXAIO		16
+
+// Request pages, one per aio slot, just below the file descriptor table
+#define AIOTABLE	0xCFFE0000
+#define INDEX2AIOPAGE(i)	((void*) (AIOTABLE + (i)*PGSIZE))
+
+// Where replies are received when the caller wants no page
+#define AIORECVVA	(AIOTABLE + MAXAIO*PGSIZE)
+
+// aio_state values
+#define AIO_FREE	0
+#define AIO_PENDING	1
+#define AIO_DONE	2
+
+static struct Aio aiotab[MAXAIO];
+
+// Number of operations waiting for a server's reply
+static int aio_nserver;
+
+// Let the device finish 'aio' given the server's reply 'value' (or 0
+// when polling).  Returns 1 if the operation is now done.
+static int
+aio_finish(struct Aio *aio, int32_t value)
+{
+	int r;
+	struct Fd *fd;
+	struct Dev *dev;
+
+	if ((r = fd_lookup(aio->aio_fdnum, &fd)) < 0
+	    || (r = dev_lookup(fd->fd_dev_id, &dev)) < 0) {
+		// The descriptor was closed under us.
+		aio->aio_result = aio->aio_server ? value : r;
+	} else if (!(*dev->dev_await)(fd, aio, value))
+		return 0;
+
+	if (debug)
+		cprintf("[%08x] aio %d done: %d\n", thisenv->env_id,
+			aio - aiotab, aio->aio_result);
+	if (aio->aio_server)
+		aio_nserver--;
+	aio->aio_state = AIO_DONE;
+	return 1;
+}
+
+// If the IPC just received from 'whom', with 'value' and the page at
+// 'va', carries back the request page of an operation in flight,
+// finish that operation, unmap the page and return 1.  Otherwise
+// return 0.
+static int
+aio_claim(envid_t whom, int32_t value, void *va, int perm)
+{
+	int i;
+	struct Aio *aio;
+
+	if (!(perm & PTE_P))
+		return 0;
+	for (i = 0; i < MAXAIO; i++) {
+		aio = &aiotab[i];
+		if (aio->aio_state == AIO_PENDING && aio->aio_server == whom
+		    && PTE_ADDR(uvpt[PGNUM(va)]) == PTE_ADDR(uvpt[PGNUM(aio->aio_page)])) {
+			sys_page_unmap(0, va);
+			aio_finish(aio, value);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Receive one IPC at 'va', waiting up to 'msec' milliseconds or
+// forever if 'msec' is ~0.  This goes straight to the kernel: what
+// ipc_recv has put aside (see ipc_defer) is never a reply.  If the IPC
+// finishes an operation in flight, return 1.  Otherwise return 0,
+// leaving the sender in *whom_store, the value in *value_store and the
+// page permissions in *perm_store.  Returns -E_TIMEOUT on timeout.
+static int
+aio_recv(void *va, unsigned msec, envid_t *whom_store,
+	 int32_t *value_store, int *perm_store)
+{
+	int r;
+
+	if (msec == ~0U)
+		r = sys_ipc_recv(va);
+	else
+		r = sys_ipc_recv_timeout(va, msec);
+	if (r < 0)
+		return r;
+	*whom_store = thisenv->env_ipc_from;
+	*value_store = thisenv->env_ipc_value;
+	*perm_store = thisenv->env_ipc_perm;
+	return aio_claim(*whom_store, *value_store, va, *perm_store);
+}
+
+// Receive the reply to a synchronous request, as ipc_recv(NULL, pg, NULL)
+// would, finishing any asynchronous operations whose replies come first.
+int32_t
+aio_ipc_recv(void *pg)
+{
+	envid_t whom;
+	int32_t value;
+	int r, perm;
+
+	while ((r = aio_recv(pg ? pg : (void*) AIORECVVA, ~0U,
+			     &whom, &value, &perm)) == 1
+	       || (r == 0 && PIPE_STRAY(value, perm)))
+		/* keep waiting */;
+	if (r < 0)
+		return r;
+	if (!pg && (perm & PTE_P))
+		sys_page_unmap(0, (void*) AIORECVVA);
+	return value;
+}
+
+// Wait up to 'msec' milliseconds, or forever if 'msec' is ~0, for a
+// message of 'value' with no page, such as a pipe wakeup.  Replies to
+// asynchronous operations that come first are finished, and anything
+// else is put aside for a later ipc_recv.  Returns 0, -E_TIMEOUT, or
+// -E_NO_MEM if nothing more can be put aside, in which case we stop
+// receiving and senders wait until ipc_recv makes room.
+int
+aio_ipc_wait(int32_t value, unsigned msec)
+{
+	unsigned end = sys_time_msec() + msec;
+	envid_t whom;
+	int32_t v;
+	int r, left, perm;
+
+	while (1) {
+		if (msec == ~0U)
+			left = ~0U;
+		else if ((left = end - sys_time_msec()) <= 0)
+			return -E_TIMEOUT;
+		if (ipc_defer_full())
+			return -E_NO_MEM;
+		if ((r = aio_recv((void*) AIORECVVA, left, &whom, &v, &perm)) < 0)
+			return r;
+		if (r == 1)
+			continue;
+		if (v == value && !(perm & PTE_P))
+			return 0;
+		if ((r = ipc_defer(whom, v, (void*) AIORECVVA, perm)) < 0)
+			return r;
+	}
+}
+
+static int
+aio_start(int fdnum, int op, void *buf, size_t n)
+{
+	int i, r;
+	struct Fd *fd;
+	struct Dev *dev;
+	struct Aio *aio;
+	int (*start)(struct Fd *fd, struct Aio *aio);
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0
+	    || (r = dev_lookup(fd->fd_dev_id, &dev)) < 0)
+		return r;
+	if ((fd->fd_omode & O_ACCMODE) == (op == AIO_READ ? O_WRONLY : O_RDONLY))
+		return -E_INVAL;
+
+	for (i = 0; i < MAXAIO; i++)
+		if (aiotab[i].aio_state == AIO_FREE)
+			break;
+	if (i == MAXAIO)
+		return -E_MAX_OPEN;
+	aio = &aiotab[i];
+	aio->aio_op = op;
+	aio->aio_fdnum = fdnum;
+	aio->aio_buf = buf;
+	aio->aio_n = n;
+	aio->aio_page = INDEX2AIOPAGE(i);
+	aio->aio_server = 0;
+
+	start = op == AIO_READ ? dev->dev_aread : dev->dev_awrite;
+	if (!start) {
+		if (op == AIO_READ)
+			aio->aio_result = (*dev->dev_read)(fd, buf, n);
+		else
+			aio->aio_result = (*dev->dev_write)(fd, buf, n);
+		aio->aio_state = AIO_DONE;
+		return i;
+	}
+
+	// Always use a fresh page: after a fork the old one is
+	// copy-on-write and could not be sent writable.
+	if ((r = sys_page_alloc(0, aio->aio_page, PTE_P|PTE_W|PTE_U)) < 0)
+		return r;
+	if ((r = (*start)(fd, aio)) < 0)
+		return r;
+	aio->aio_state = AIO_PENDING;
+	if (aio->aio_server)
+		aio_nserver++;
+	if (debug)
+		cprintf("[%08x] aio %d started on fd %d via dev %s\n",
+			thisenv->env_id, i, fdnum, dev->dev_name);
+	return i;
+}
+
+// Start reading at most 'n' bytes from 'fdnum' into 'buf'.
+// 'buf' must stay valid until await_any() reports the operation done.
+// Returns the aio id on success, < 0 on error.
+int
+aread(int fdnum, void *buf, size_t n)
+{
+	return aio_start(fdnum, AIO_READ, buf, n);
+}
+
+// Start writing at most 'n' bytes from 'buf' to 'fdnum'.
+// Like write(), the operation may complete having written fewer bytes.
+// Returns the aio id on success, < 0 on error.
+int
+awrite(int fdnum, const void *buf, size_t n)
+{
+	return aio_start(fdnum, AIO_WRITE, (void*) buf, n);
+}
+
+// Wait for any operation started by aread() or awrite() to finish.
+// Stores its result (bytes transferred or < 0) in *result_store and
+// returns its aio id, or returns -E_INVAL if nothing is in flight.
+//
+// While operations on a server are in flight we block receiving IPCs, so
+// polled operations are only rechecked when a reply wakes us up.  Other
+// IPCs that arrive are put aside for ipc_recv; once no more can be,
+// this returns -E_NO_MEM rather than lose any, and the caller has to
+// ipc_recv them before waiting again.
+int
+await_any(ssize_t *result_store)
+{
+	int i, r, perm, pending;
+	int32_t value;
+	envid_t whom;
+
+	while (1) {
+		pending = 0;
+		for (i = 0; i < MAXAIO; i++) {
+			if (aiotab[i].aio_state == AIO_PENDING
+			    && !aiotab[i].aio_server)
+				aio_finish(&aiotab[i], 0);
+			if (aiotab[i].aio_state == AIO_DONE) {
+				aiotab[i].aio_state = AIO_FREE;
+				if (result_store)
+					*result_store = aiotab[i].aio_result;
+				return i;
+			}
+			if (aiotab[i].aio_state == AIO_PENDING)
+				pending++;
+		}
+		if (!pending)
+			return -E_INVAL;
+
+		if (aio_nserver == 0)
+			sys_yield();
+		else if (ipc_defer_full())
+			return -E_NO_MEM;
+		else if (aio_recv((void*) AIORECVVA, ~0U, &whom, &value, &perm) == 0
+			 && !PIPE_STRAY(value, perm)
+			 && (r = ipc_defer(whom, value, (void*) AIORECVVA, perm)) < 0)
+			return r;
+	}
+}
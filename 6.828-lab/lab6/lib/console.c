@@ -38,6 +38,7 @@ static ssize_t devcons_read(struct Fd*, void*, size_t);
 static ssize_t devcons_write(struct Fd*, const void*, size_t);
 static int devcons_close(struct Fd*);
 static int devcons_stat(struct Fd*, struct Stat*);
+static int devcons_poll(struct Fd*, int);
 
 struct Dev devcons =
 {
@@ -46,9 +47,14 @@ struct Dev devcons =
 	.dev_read =	devcons_read,
 	.dev_write =	devcons_write,
 	.dev_close =	devcons_close,
-	.dev_stat =	devcons_stat
+	.dev_stat =	devcons_stat,
+	.dev_poll =	devcons_poll
 };
 
+// The kernel can't tell us whether a key is waiting without taking it,
+// so devcons_poll keeps it here for the next devcons_read.
+static int cons_pending;
+
 int
 iscons(int fdnum)
 {
@@ -83,8 +89,11 @@ devcons_read(struct Fd *fd, void *vbuf, size_t n)
 	if (n == 0)
 		return 0;
 
-	while ((c = sys_cgetc()) == 0)
-		sys_yield();
+	if ((c = cons_pending) != 0)
+		cons_pending = 0;
+	else
+		while ((c = sys_cgetc()) == 0)
+			sys_yield();
 	if (c < 0)
 		return c;
 	if (c == 0x04)	// ctl-d is eof
@@ -96,19 +105,9 @@ devcons_read(struct Fd *fd, void *vbuf, size_t n)
 static ssize_t
 devcons_write(struct Fd *fd, const void *vbuf, size_t n)
 {
-	int tot, m;
-	char buf[128];
-
-	// mistake: have to nul-terminate arg to sys_cputs,
-	// so we have to copy vbuf into buf in chunks and nul-terminate.
-	for (tot = 0; tot < n; tot += m) {
-		m = n - tot;
-		if (m > sizeof(buf) - 1)
-			m = sizeof(buf) - 1;
-		memmove(buf, (char*)vbuf + tot, m);
-		sys_cputs(buf, m);
-	}
-	return tot;
+	// sys_cputs takes a length, so the whole buffer goes in one call
+	sys_cputs(vbuf, n);
+	return n;
 }
 
 static int
@@ -126,3 +125,10 @@ devcons_stat(struct Fd *fd, struct Stat *stat)
 	return 0;
 }
 
+static int
+devcons_poll(struct Fd *fd, int events)
+{
+	if (cons_pending == 0)
+		cons_pending = sys_cgetc();
+	return events & (cons_pending ? POLLIN|POLLOUT : POLLOUT);
+}
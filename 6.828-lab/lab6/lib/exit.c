@@ -5,6 +5,7 @@ void
 exit(void)
 {
 	// close_all();
+	fflush(NULL);
 	sys_env_destroy(0);
 }
 
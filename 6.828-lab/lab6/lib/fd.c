@@ -325,3 +325,94 @@ stat(const char *path, struct Stat *stat)
 	return r;
 }
 
+
+// How long poll waits in the network server at a time when it also has
+// pipes or the console to watch, in milliseconds
+#define POLL_SLICE	10
+
+// Wait until one of the 'nfds' descriptors in 'fds' is ready for the
+// events it asks for, or for 'timeout' milliseconds (forever if < 0).
+// Sets each entry's revents and returns the number of entries with any
+// revents set, 0 on timeout, or < 0 on error.
+//
+// Sockets are handed to the network server in a single select request,
+// which blocks there rather than here when there is nothing else to
+// watch.  Other devices are asked through dev_poll.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+	fd_set rset, wset, eset;
+	unsigned now, deadline;
+	int i, r, wait, nready, nsock, maxsock;
+	struct Dev *dev;
+	struct Fd *fd;
+
+	deadline = sys_time_msec() + (timeout > 0 ? timeout : 0);
+	while (1) {
+		nready = nsock = maxsock = 0;
+		FD_ZERO(&rset);
+		FD_ZERO(&wset);
+		FD_ZERO(&eset);
+
+		for (i = 0; i < nfds; i++) {
+			fds[i].revents = 0;
+			if (fds[i].fd < 0)
+				continue;
+			if (fd_lookup(fds[i].fd, &fd) < 0
+			    || dev_lookup(fd->fd_dev_id, &dev) < 0)
+				fds[i].revents = POLLNVAL;
+			else if (dev == &devsock) {
+				r = fd->fd_sock.sockid;
+				if (fds[i].events & POLLIN)
+					FD_SET(r, &rset);
+				if (fds[i].events & POLLOUT)
+					FD_SET(r, &wset);
+				FD_SET(r, &eset);
+				maxsock = MAX(maxsock, r + 1);
+				nsock++;
+				continue;
+			} else if (dev->dev_poll)
+				fds[i].revents = dev->dev_poll(fd, fds[i].events);
+			else
+				fds[i].revents = fds[i].events & (POLLIN|POLLOUT);
+			if (fds[i].revents)
+				nready++;
+		}
+
+		now = sys_time_msec();
+		if (nready || timeout == 0 || (timeout > 0 && now >= deadline))
+			wait = 0;
+		else if (timeout > 0)
+			wait = deadline - now;
+		else
+			wait = -1;
+		// Only block in the server if no other device needs watching
+		if (wait != 0 && nsock < nfds)
+			wait = wait < 0 ? POLL_SLICE : MIN(wait, POLL_SLICE);
+
+		if (nsock) {
+			if ((r = nsipc_select(maxsock, &rset, &wset, &eset, wait)) < 0)
+				return r;
+			for (i = 0; i < nfds; i++) {
+				if (fds[i].fd < 0 || fd_lookup(fds[i].fd, &fd) < 0
+				    || fd->fd_dev_id != devsock.dev_id)
+					continue;
+				r = fd->fd_sock.sockid;
+				if (FD_ISSET(r, &rset))
+					fds[i].revents |= POLLIN;
+				if (FD_ISSET(r, &wset))
+					fds[i].revents |= POLLOUT;
+				if (FD_ISSET(r, &eset))
+					fds[i].revents |= POLLERR;
+				if (fds[i].revents)
+					nready++;
+			}
+		}
+
+		if (nready || timeout == 0
+		    || (timeout > 0 && sys_time_msec() >= deadline))
+			return nready;
+		if (!nsock)
+			sys_yield();
+	}
+}
@@ -11,6 +11,8 @@
 */
 union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 
+static envid_t fsenv;
+
 // Send an inter-environment request to the file server, and wait for
 // a reply.  The request body should be in fsipcbuf, and parts of the
 // response may be written back to fsipcbuf.
@@ -20,8 +22,6 @@ union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 static int
 fsipc(unsigned type, void *dstva)
 {
-	static envid_t fsenv;
-	
 	//找到文件系统对应的envid
 	if (fsenv == 0)
 		fsenv = ipc_find_env(ENV_TYPE_FS);
@@ -37,7 +37,23 @@ fsipc(unsigned type, void *dstva)
 
 	//接受来自文件系统返回的响应
 	//hi,把需要发送给我的数据放到dstva处吧~
-	return ipc_recv(NULL, dstva, NULL);
+	return aio_ipc_recv(dstva);
+}
+
+// Send an asynchronous request to the file server.  The request body
+// is in 'req', a page of the caller's own; the server maps it back with
+// its reply, which lib/aio.c picks up.  Returns the server's envid.
+static envid_t
+fsipc_async(unsigned type, union Fsipc *req)
+{
+	if (fsenv == 0)
+		fsenv = ipc_find_env(ENV_TYPE_FS);
+
+	if (debug)
+		cprintf("[%08x] fsipc_async %d %08x\n", thisenv->env_id, type, *(uint32_t *)req);
+
+	ipc_send(fsenv, type | IPCREQ_ASYNC, req, PTE_P | PTE_W | PTE_U);
+	return fsenv;
 }
 
 static int devfile_flush(struct Fd *fd);
@@ -45,6 +61,9 @@ static ssize_t devfile_read(struct Fd *fd, void *buf, size_t n);
 static ssize_t devfile_write(struct Fd *fd, const void *buf, size_t n);
 static int devfile_stat(struct Fd *fd, struct Stat *stat);
 static int devfile_trunc(struct Fd *fd, off_t newsize);
+static int devfile_aread(struct Fd *fd, struct Aio *aio);
+static int devfile_awrite(struct Fd *fd, struct Aio *aio);
+static int devfile_await(struct Fd *fd, struct Aio *aio, int32_t value);
 
 struct Dev devfile =
 {
@@ -54,7 +73,10 @@ struct Dev devfile =
 	.dev_close =	devfile_flush,
 	.dev_stat =	devfile_stat,
 	.dev_write =	devfile_write,
-	.dev_trunc =	devfile_trunc
+	.dev_trunc =	devfile_trunc,
+	.dev_aread =	devfile_aread,
+	.dev_awrite =	devfile_awrite,
+	.dev_await =	devfile_await
 };
 
 // Open a file (or directory).
@@ -198,6 +220,46 @@ devfile_write(struct Fd *fd, const void *buf, size_t n)
 	// panic("devfile_write not implemented");
 }
 
+// Start an FSREQ_READ of at most aio->aio_n bytes on the aio's own page.
+static int
+devfile_aread(struct Fd *fd, struct Aio *aio)
+{
+	union Fsipc *req = aio->aio_page;
+
+	req->read.req_fileid = fd->fd_file.id;
+	req->read.req_n = MIN(aio->aio_n, sizeof(req->readRet.ret_buf));
+	aio->aio_server = fsipc_async(FSREQ_READ, req);
+	return 0;
+}
+
+// Start an FSREQ_WRITE of at most aio->aio_n bytes on the aio's own page.
+static int
+devfile_awrite(struct Fd *fd, struct Aio *aio)
+{
+	union Fsipc *req = aio->aio_page;
+	size_t n = MIN(aio->aio_n, sizeof(req->write.req_buf));
+
+	req->write.req_fileid = fd->fd_file.id;
+	req->write.req_n = n;
+	memmove(req->write.req_buf, aio->aio_buf, n);
+	aio->aio_server = fsipc_async(FSREQ_WRITE, req);
+	return 0;
+}
+
+// The file server replied 'value' to an asynchronous read or write.
+static int
+devfile_await(struct Fd *fd, struct Aio *aio, int32_t value)
+{
+	union Fsipc *req = aio->aio_page;
+
+	if (aio->aio_op == AIO_READ && value > 0) {
+		assert(value <= aio->aio_n);
+		memmove(aio->aio_buf, req->readRet.ret_buf, value);
+	}
+	aio->aio_result = value;
+	return 1;
+}
+
 static int
 devfile_stat(struct Fd *fd, struct Stat *st)
 {
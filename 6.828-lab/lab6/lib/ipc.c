@@ -2,6 +2,73 @@
 
 #include <inc/lib.h>
 
+// Messages put aside by ipc_defer, in a ring, for ipc_recv to return
+// oldest first before anything new.  The page a message brought is
+// kept at the DEFERPAGE of its slot.
+#define NDEFER		256
+#define IPCDEFERVA	0xCFE00000	// NDEFER pages, below the aio table
+#define DEFERPAGE(i)	((void *) (IPCDEFERVA + (i) * PGSIZE))
+
+static struct {
+	envid_t from;
+	int32_t value;
+	int perm;
+} deferred[NDEFER];
+static unsigned defer_head, defer_tail;	// next to return, next free
+
+// Is there no room to put aside another message?  Callers then stop
+// receiving, so that senders wait in ipc_send instead of anything
+// being lost.
+bool
+ipc_defer_full(void)
+{
+	return defer_tail - defer_head == NDEFER;
+}
+
+// Put aside a message that arrived while we waited for another, with
+// the page it brought at 'va' if 'perm' says there is one.  The next
+// ipc_recv returns it.  Returns 0, or < 0 if it cannot be put aside,
+// -E_NO_MEM if ipc_defer_full() said so; the page is then left at 'va'.
+int
+ipc_defer(envid_t from, int32_t value, void *va, int perm)
+{
+	unsigned i = defer_tail % NDEFER;
+	int r;
+
+	if (ipc_defer_full())
+		return -E_NO_MEM;
+	if (perm & PTE_P) {
+		if ((r = sys_page_map(0, va, 0, DEFERPAGE(i), perm)) < 0)
+			return r;
+		sys_page_unmap(0, va);
+	}
+	deferred[i].from = from;
+	deferred[i].value = value;
+	deferred[i].perm = perm;
+	defer_tail++;
+	return 0;
+}
+
+// Return the oldest message put aside, as ipc_recv would.
+static int32_t
+ipc_undefer(envid_t *from_env_store, void *pg, int *perm_store)
+{
+	unsigned i = defer_head++ % NDEFER;
+	int perm = deferred[i].perm;
+
+	if (from_env_store)
+		*from_env_store = deferred[i].from;
+	if (perm & PTE_P) {
+		if ((uintptr_t) pg >= UTOP
+		    || sys_page_map(0, DEFERPAGE(i), 0, pg, perm) < 0)
+			perm = 0;
+		sys_page_unmap(0, DEFERPAGE(i));
+	}
+	if (perm_store)
+		*perm_store = perm;
+	return deferred[i].value;
+}
+
 // Receive a value via IPC and return it.
 // If 'pg' is nonnull, then any page sent by the sender will be mapped at
 //	that address.
@@ -28,8 +95,13 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 		// no page
 		pg = (void*)UTOP;
 	}
+	if (defer_head != defer_tail)
+		return ipc_undefer(from_env_store, pg, perm_store);
 	int result;
-	result = sys_ipc_recv(pg);
+	// Skip pipe wakeups that came too late (see lib/pipe.c)
+	while ((result = sys_ipc_recv(pg)) == 0
+	       && PIPE_STRAY(thisenv->env_ipc_value, thisenv->env_ipc_perm))
+		/* not ours */;
 	if(result < 0) {
 		if(from_env_store != NULL) {
 			*from_env_store = 0;
@@ -53,6 +125,40 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 
 }
 
+// Like ipc_recv, but wait at most 'msec' milliseconds.  Returns the
+// value sent, or -E_TIMEOUT if none came in time (with *from_env_store
+// and *perm_store set to 0).
+int
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 unsigned int msec)
+{
+	unsigned end = sys_time_msec() + msec;
+	int r, left;
+
+	if (pg == NULL)
+		pg = (void *) UTOP;
+	if (defer_head != defer_tail)
+		return ipc_undefer(from_env_store, pg, perm_store);
+	// Skip pipe wakeups that came too late (see lib/pipe.c)
+	while ((r = sys_ipc_recv_timeout(pg, msec)) == 0
+	       && PIPE_STRAY(thisenv->env_ipc_value, thisenv->env_ipc_perm)) {
+		left = end - sys_time_msec();
+		msec = left > 0 ? left : 0;
+	}
+	if (r < 0) {
+		if (from_env_store)
+			*from_env_store = 0;
+		if (perm_store)
+			*perm_store = 0;
+		return r;
+	}
+	if (from_env_store)
+		*from_env_store = thisenv->env_ipc_from;
+	if (perm_store)
+		*perm_store = thisenv->env_ipc_perm;
+	return thisenv->env_ipc_value;
+}
+
 // Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'toenv'.
 // This function keeps trying until it succeeds.
 // It should panic() on any error other than -E_IPC_NOT_RECV.
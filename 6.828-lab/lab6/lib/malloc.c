@@ -2,25 +2,54 @@
 #include <inc/lib.h>
 
 /*
- * Simple malloc/free.
+ * Size-class slab allocator.
  *
- * Uses the address space to do most of the hard work.
- * The address space from mbegin to mend is scanned
- * in order.  Pages are allocated, used to fill successive
- * malloc requests, and then left alone.  Free decrements
- * a ref count maintained in the page; the page is freed
- * when the ref count hits zero.
+ * Small requests are rounded up to one of a few size classes.  Each
+ * class draws its objects from slabs: single pages that start with a
+ * struct slab header and are carved into equal objects after it.  A
+ * slab keeps its own list of free objects, and each class keeps a list
+ * of the slabs that have any, so malloc and free take constant time.
+ * A slab whose objects have all been freed goes back to the kernel,
+ * unless it is the only one its class has left.
  *
- * If we need to allocate a large amount (more than a page)
- * we can't put a ref count at the end of each page,
- * so we mark the pte entry with the bit PTE_CONTINUED.
+ * Requests too big for the largest class get a run of whole pages,
+ * with the header at the front of the first.  Either way the header of
+ * any block is at ROUNDDOWN(block, PGSIZE), which is how free and
+ * realloc learn its size.
+ *
+ * Address space from mbegin to mend is handed out next-fit, skipping
+ * anything already mapped there.
  */
 enum
 {
 	MAXMALLOC = 1024*1024	/* max size of one allocated chunk */
 };
 
-#define PTE_CONTINUED 0x200
+#define SLAB_MAGIC	0x51AB51AB
+#define SLAB_LARGE	0xffff		/* s_class of a run of pages */
+
+struct slab {
+	uint32_t s_magic;
+	uint16_t s_class;		// index into class_size, or SLAB_LARGE
+	uint16_t s_inuse;		// objects handed out
+	uint32_t s_npages;		// pages in a large block
+	void *s_free;			// free objects, linked through their first word
+	struct slab *s_next;		// slabs of this class with free objects
+	struct slab **s_prevp;
+};
+
+// Objects start this far into a slab; keeps them 16-byte aligned
+#define SLAB_HDRSIZE	ROUNDUP(sizeof(struct slab), 16)
+
+// The last two classes are the largest multiples of 16 of which 4 and
+// 2 objects fit in a slab
+static const uint16_t class_size[] = {
+	16, 32, 64, 128, 256, 512, 1008, 2032
+};
+#define NCLASS	ARRAY_SIZE(class_size)
+
+// Slabs with free objects, per class
+static struct slab *class_slabs[NCLASS];
 
 static uint8_t *mbegin = (uint8_t*) 0x08000000;
 static uint8_t *mend   = (uint8_t*) 0x10000000;
@@ -38,103 +67,215 @@ isfree(void *v, size_t n)
 	return 1;
 }
 
-void*
-malloc(size_t n)
+// Map 'npages' fresh pages at the next free stretch of address space.
+static void *
+page_run_alloc(size_t npages)
 {
-	int i, cont;
-	int nwrap;
-	uint32_t *ref;
-	void *v;
+	size_t n = npages * PGSIZE;
+	int i, nwrap = 0;
+	uint8_t *v;
 
 	if (mptr == 0)
 		mptr = mbegin;
-
-	n = ROUNDUP(n, 4);
-
-	if (n >= MAXMALLOC)
-		return 0;
-
-	if ((uintptr_t) mptr % PGSIZE){
-		/*
-		 * we're in the middle of a partially
-		 * allocated page - can we add this chunk?
-		 * the +4 below is for the ref count.
-		 */
-		ref = (uint32_t*) (ROUNDUP(mptr, PGSIZE) - 4);
-		if ((uintptr_t) mptr / PGSIZE == (uintptr_t) (mptr + n - 1 + 4) / PGSIZE) {
-			(*ref)++;
-			v = mptr;
-			mptr += n;
-			return v;
-		}
-		/*
-		 * stop working on this page and move on.
-		 */
-		free(mptr);	/* drop reference to this page */
-		mptr = ROUNDDOWN(mptr + PGSIZE, PGSIZE);
-	}
-
-	/*
-	 * now we need to find some address space for this chunk.
-	 * if it's less than a page we leave it open for allocation.
-	 * runs of more than a page can't have ref counts so we
-	 * flag the PTE entries instead.
-	 */
-	nwrap = 0;
-	while (1) {
-		if (isfree(mptr, n + 4))
-			break;
+	while (!isfree(mptr, n)) {
 		mptr += PGSIZE;
-		if (mptr == mend) {
+		if (mptr + n > mend) {
 			mptr = mbegin;
 			if (++nwrap == 2)
 				return 0;	/* out of address space */
 		}
 	}
 
-	/*
-	 * allocate at mptr - the +4 makes sure we allocate a ref count.
-	 */
-	for (i = 0; i < n + 4; i += PGSIZE){
-		cont = (i + PGSIZE < n + 4) ? PTE_CONTINUED : 0;
-		if (sys_page_alloc(0, mptr + i, PTE_P|PTE_U|PTE_W|cont) < 0){
-			for (; i >= 0; i -= PGSIZE)
+	for (i = 0; i < n; i += PGSIZE)
+		if (sys_page_alloc(0, mptr + i, PTE_P|PTE_U|PTE_W) < 0) {
+			while ((i -= PGSIZE) >= 0)
 				sys_page_unmap(0, mptr + i);
 			return 0;	/* out of physical memory */
 		}
-	}
-
-	ref = (uint32_t*) (mptr + i - 4);
-	*ref = 2;	/* reference for mptr, reference for returned block */
 	v = mptr;
 	mptr += n;
+	if (mptr == mend)
+		mptr = mbegin;
+	return v;
+}
+
+static void
+page_run_free(void *v, size_t npages)
+{
+	size_t i;
+
+	for (i = 0; i < npages; i++)
+		sys_page_unmap(0, (uint8_t *) v + i * PGSIZE);
+}
+
+static void
+slab_link(struct slab *s)
+{
+	struct slab **head = &class_slabs[s->s_class];
+
+	if ((s->s_next = *head))
+		(*head)->s_prevp = &s->s_next;
+	s->s_prevp = head;
+	*head = s;
+}
+
+static void
+slab_unlink(struct slab *s)
+{
+	if (s->s_next)
+		s->s_next->s_prevp = s->s_prevp;
+	*s->s_prevp = s->s_next;
+	s->s_next = 0;
+	s->s_prevp = 0;
+}
+
+// Start a new slab for class 'c' and put it on the class's list.
+static struct slab *
+slab_new(int c)
+{
+	struct slab *s;
+	uint8_t *obj;
+	void **tail;
+
+	if (!(s = page_run_alloc(1)))
+		return 0;
+	s->s_magic = SLAB_MAGIC;
+	s->s_class = c;
+	s->s_inuse = 0;
+	s->s_npages = 1;
+	tail = &s->s_free;
+	for (obj = (uint8_t *) s + SLAB_HDRSIZE;
+	     obj + class_size[c] <= (uint8_t *) s + PGSIZE;
+	     obj += class_size[c]) {
+		*tail = obj;
+		tail = (void **) obj;
+	}
+	*tail = 0;
+	slab_link(s);
+	return s;
+}
+
+static struct slab *
+block_slab(void *v)
+{
+	struct slab *s = ROUNDDOWN(v, PGSIZE);
+
+	assert(mbegin <= (uint8_t*) v && (uint8_t*) v < mend);
+	assert(s->s_magic == SLAB_MAGIC);
+	return s;
+}
+
+// How many bytes the block at 'v' can hold.
+static size_t
+block_size(void *v)
+{
+	struct slab *s = block_slab(v);
+
+	if (s->s_class == SLAB_LARGE)
+		return s->s_npages * PGSIZE - SLAB_HDRSIZE;
+	return class_size[s->s_class];
+}
+
+void*
+malloc(size_t n)
+{
+	struct slab *s;
+	void *v;
+	int c;
+
+	if (n >= MAXMALLOC)
+		return 0;
+
+	for (c = 0; c < NCLASS; c++)
+		if (n <= class_size[c])
+			break;
+
+	if (c == NCLASS) {
+		size_t npages = ROUNDUP(n + SLAB_HDRSIZE, PGSIZE) / PGSIZE;
+
+		if (!(s = page_run_alloc(npages)))
+			return 0;
+		s->s_magic = SLAB_MAGIC;
+		s->s_class = SLAB_LARGE;
+		s->s_inuse = 1;
+		s->s_npages = npages;
+		s->s_free = 0;
+		s->s_next = 0;
+		s->s_prevp = 0;
+		return (uint8_t *) s + SLAB_HDRSIZE;
+	}
+
+	if (!(s = class_slabs[c]) && !(s = slab_new(c)))
+		return 0;
+	v = s->s_free;
+	s->s_free = *(void **) v;
+	s->s_inuse++;
+	// A full slab leaves the list until something in it is freed
+	if (!s->s_free)
+		slab_unlink(s);
 	return v;
 }
 
 void
 free(void *v)
 {
-	uint8_t *c;
-	uint32_t *ref;
+	struct slab *s;
 
 	if (v == 0)
 		return;
-	assert(mbegin <= (uint8_t*) v && (uint8_t*) v < mend);
+	s = block_slab(v);
 
-	c = ROUNDDOWN(v, PGSIZE);
+	if (s->s_class == SLAB_LARGE) {
+		s->s_magic = 0;
+		page_run_free(s, s->s_npages);
+		return;
+	}
 
-	while (uvpt[PGNUM(c)] & PTE_CONTINUED) {
-		sys_page_unmap(0, c);
-		c += PGSIZE;
-		assert(mbegin <= c && c < mend);
+	if (!s->s_free)
+		slab_link(s);
+	*(void **) v = s->s_free;
+	s->s_free = v;
+	if (--s->s_inuse == 0
+	    && (s->s_next || class_slabs[s->s_class] != s)) {
+		// Keep one empty slab per class, so a malloc/free pair at
+		// a slab boundary does not map and unmap a page each time
+		slab_unlink(s);
+		s->s_magic = 0;
+		page_run_free(s, 1);
 	}
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	void *v;
 
-	/*
-	 * c is just a piece of this page, so dec the ref count
-	 * and maybe free the page.
-	 */
-	ref = (uint32_t*) (c + PGSIZE - 4);
-	if (--(*ref) == 0)
-		sys_page_unmap(0, c);
+	if (size && nmemb > MAXMALLOC / size)
+		return 0;
+	if ((v = malloc(nmemb * size)))
+		memset(v, 0, nmemb * size);
+	return v;
 }
 
+void *
+realloc(void *v, size_t n)
+{
+	void *nv;
+	size_t old;
+
+	if (v == 0)
+		return malloc(n);
+	if (n == 0) {
+		free(v);
+		return 0;
+	}
+	// Grow or shrink in place while the block still fits
+	old = block_size(v);
+	if (n <= old && (n > old / 2 || old <= class_size[0]))
+		return v;
+	if (!(nv = malloc(n)))
+		return 0;
+	memmove(nv, v, MIN(old, n));
+	free(v);
+	return nv;
+}
@@ -8,6 +8,8 @@
 #define REQVA		0x0ffff000
 union Nsipc nsipcbuf __attribute__((aligned(PGSIZE)));
 
+static envid_t nsenv;
+
 // Send an IP request to the network server, and wait for a reply.
 // The request body should be in nsipcbuf, and parts of the response
 // may be written back to nsipcbuf.
@@ -16,7 +18,6 @@ union Nsipc nsipcbuf __attribute__((aligned(PGSIZE)));
 static int
 nsipc(unsigned type)
 {
-	static envid_t nsenv;
 	if (nsenv == 0)
 		nsenv = ipc_find_env(ENV_TYPE_NS);
 
@@ -26,7 +27,23 @@ nsipc(unsigned type)
 		cprintf("[%08x] nsipc %d\n", thisenv->env_id, type);
 
 	ipc_send(nsenv, type, &nsipcbuf, PTE_P|PTE_W|PTE_U);
-	return ipc_recv(NULL, NULL, NULL);
+	return aio_ipc_recv(NULL);
+}
+
+// Send an asynchronous request to the network server.  The request body
+// is in 'req', a page of the caller's own; the server maps it back with
+// its reply, which lib/aio.c picks up.  Returns the server's envid.
+static envid_t
+nsipc_async(unsigned type, union Nsipc *req)
+{
+	if (nsenv == 0)
+		nsenv = ipc_find_env(ENV_TYPE_NS);
+
+	if (debug)
+		cprintf("[%08x] nsipc_async %d\n", thisenv->env_id, type);
+
+	ipc_send(nsenv, type | IPCREQ_ASYNC, req, PTE_P|PTE_W|PTE_U);
+	return nsenv;
 }
 
 int
@@ -106,13 +123,79 @@ int
 nsipc_send(int s, const void *buf, int size, unsigned int flags)
 {
 	nsipcbuf.send.req_s = s;
-	assert(size < 1600);
+	assert(size <= PGSIZE - sizeof(struct Nsreq_send));
 	memmove(&nsipcbuf.send.req_buf, buf, size);
 	nsipcbuf.send.req_size = size;
 	nsipcbuf.send.req_flags = flags;
 	return nsipc(NSREQ_SEND);
 }
 
+int
+nsipc_sendfile(int s, int fileid, off_t offset, size_t count)
+{
+	nsipcbuf.sendfile.req_s = s;
+	nsipcbuf.sendfile.req_fileid = fileid;
+	nsipcbuf.sendfile.req_offset = offset;
+	nsipcbuf.sendfile.req_count = count;
+	return nsipc(NSREQ_SENDFILE);
+}
+
+// Wait up to 'timeout' milliseconds (forever if < 0) until one of the
+// sockets in the sets is ready.  The sets are updated to hold the ready
+// sockets; returns how many there are.
+int
+nsipc_select(int maxfdp1, fd_set *readset, fd_set *writeset,
+	     fd_set *exceptset, int timeout)
+{
+	int r;
+
+	nsipcbuf.select.req_maxfdp1 = maxfdp1;
+	nsipcbuf.select.req_readset = *readset;
+	nsipcbuf.select.req_writeset = *writeset;
+	nsipcbuf.select.req_exceptset = *exceptset;
+	nsipcbuf.select.req_timeout = timeout;
+	if ((r = nsipc(NSREQ_SELECT)) >= 0) {
+		*readset = nsipcbuf.select.req_readset;
+		*writeset = nsipcbuf.select.req_writeset;
+		*exceptset = nsipcbuf.select.req_exceptset;
+	}
+	return r;
+}
+
+// Copy the network server's performance counters into 'st'.
+int
+nsipc_stats(struct Nsret_stats *st)
+{
+	int r;
+
+	if ((r = nsipc(NSREQ_STATS)) >= 0)
+		memmove(st, &nsipcbuf.statsRet, sizeof(*st));
+	return r;
+}
+
+// Start receiving at most 'len' bytes on the request page 'req'.
+// The data is left in req->recvRet.ret_buf.
+envid_t
+nsipc_arecv(int s, union Nsipc *req, int len, unsigned int flags)
+{
+	req->recv.req_s = s;
+	req->recv.req_len = MIN(len, PGSIZE);
+	req->recv.req_flags = flags;
+	return nsipc_async(NSREQ_RECV, req);
+}
+
+// Start sending 'size' bytes of 'buf' on the request page 'req'.
+envid_t
+nsipc_asend(int s, union Nsipc *req, const void *buf, int size, unsigned int flags)
+{
+	assert(size <= PGSIZE - sizeof(struct Nsreq_send));
+	req->send.req_s = s;
+	memmove(&req->send.req_buf, buf, size);
+	req->send.req_size = size;
+	req->send.req_flags = flags;
+	return nsipc_async(NSREQ_SEND, req);
+}
+
 int
 nsipc_socket(int domain, int type, int protocol)
 {
@@ -6,6 +6,9 @@ static ssize_t devpipe_read(struct Fd *fd, void *buf, size_t n);
 static ssize_t devpipe_write(struct Fd *fd, const void *buf, size_t n);
 static int devpipe_stat(struct Fd *fd, struct Stat *stat);
 static int devpipe_close(struct Fd *fd);
+static int devpipe_astart(struct Fd *fd, struct Aio *aio);
+static int devpipe_await(struct Fd *fd, struct Aio *aio, int32_t value);
+static int devpipe_poll(struct Fd *fd, int events);
 
 struct Dev devpipe =
 {
@@ -15,13 +18,36 @@ struct Dev devpipe =
 	.dev_write =	devpipe_write,
 	.dev_close =	devpipe_close,
 	.dev_stat =	devpipe_stat,
+	.dev_aread =	devpipe_astart,
+	.dev_awrite =	devpipe_astart,
+	.dev_await =	devpipe_await,
+	.dev_poll =	devpipe_poll,
 };
 
-#define PIPEBUFSIZ 32		// small to provoke races
+// A pipe is one page shared by both ends: a ring buffer filling the
+// rest of the page after the header.  Positions run modulo twice the
+// buffer size, so that a full ring can be told from an empty one.
+//
+// Each end copies whole contiguous spans.  An end that must wait
+// publishes its envid in p_rwait or p_wwait and blocks in IPC; the
+// other end, after making progress, claims the slot (clearing it with
+// a compare-and-swap) and tries once to send it PIPE_WAKEUP.  If the
+// waiter is not receiving yet, the wakeup is not sent and the waiter
+// finds the progress when its wait times out after PIPE_WAIT_MSEC,
+// which also lets it notice the other end dying without closing the
+// pipe.  A waiter that gives up first withdraws by clearing the slot
+// itself; if it loses that race, a wakeup may still reach a later
+// receive, which skips it as a stray (see PIPE_STRAY in inc/lib.h).
+#define PIPEBUFSIZ	(PGSIZE - 4 * sizeof(uint32_t))
+#define PIPEPOSMOD	(2 * PIPEBUFSIZ)
+
+#define PIPE_WAIT_MSEC	100
 
 struct Pipe {
-	off_t p_rpos;		// read position
-	off_t p_wpos;		// write position
+	volatile uint32_t p_rpos;	// read position
+	volatile uint32_t p_wpos;	// write position
+	volatile envid_t p_rwait;	// reader waiting for data
+	volatile envid_t p_wwait;	// writer waiting for room
 	uint8_t p_buf[PIPEBUFSIZ];	// data buffer
 };
 
@@ -32,6 +58,8 @@ pipe(int pfd[2])
 	struct Fd *fd0, *fd1;
 	void *va;
 
+	static_assert(sizeof(struct Pipe) == PGSIZE);
+
 	// allocate the file descriptor table entries
 	if ((r = fd_alloc(&fd0)) < 0
 	    || (r = sys_page_alloc(0, fd0, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
@@ -101,38 +129,139 @@ pipeisclosed(int fdnum)
 	return _pipeisclosed(fd, p);
 }
 
+// Bytes waiting in the pipe
+static size_t
+pipe_used(struct Pipe *p)
+{
+	return (p->p_wpos + PIPEPOSMOD - p->p_rpos) % PIPEPOSMOD;
+}
+
+// Copy up to 'n' waiting bytes out of the pipe, in at most two spans.
+static size_t
+pipe_get(struct Pipe *p, uint8_t *buf, size_t n)
+{
+	uint32_t rpos = p->p_rpos;
+	size_t off = rpos % PIPEBUFSIZ, m;
+
+	n = MIN(n, pipe_used(p));
+	m = MIN(n, PIPEBUFSIZ - off);
+	memmove(buf, p->p_buf + off, m);
+	memmove(buf + m, p->p_buf, n - m);
+	// wait to move rpos until the bytes are taken!
+	asm volatile("" ::: "memory");
+	p->p_rpos = (rpos + n) % PIPEPOSMOD;
+	return n;
+}
+
+// Copy up to 'n' bytes into the pipe's free space.
+static size_t
+pipe_put(struct Pipe *p, const uint8_t *buf, size_t n)
+{
+	uint32_t wpos = p->p_wpos;
+	size_t off = wpos % PIPEBUFSIZ, m;
+
+	n = MIN(n, PIPEBUFSIZ - pipe_used(p));
+	m = MIN(n, PIPEBUFSIZ - off);
+	memmove(p->p_buf + off, buf, m);
+	memmove(p->p_buf, buf + m, n - m);
+	// wait to move wpos until the bytes are stored!
+	asm volatile("" ::: "memory");
+	p->p_wpos = (wpos + n) % PIPEPOSMOD;
+	return n;
+}
+
+// Claim the waiter in '*slot', if any.  Returns its envid, to be
+// passed to pipe_wake, or 0.
+static envid_t
+pipe_claim(volatile envid_t *slot)
+{
+	envid_t w = *slot;
+
+	if (w && __sync_bool_compare_and_swap(slot, w, 0))
+		return w;
+	return 0;
+}
+
+static void
+pipe_wake(envid_t w)
+{
+	// If it is not receiving yet, it will time out and look again
+	(void) sys_ipc_try_send(w, PIPE_WAKEUP, (void *) UTOP, 0);
+}
+
+// Stop waiting on '*slot'.  If the other end claimed us already, its
+// wakeup may still come; receivers skip it as a stray.
+static void
+pipe_unwait(volatile envid_t *slot)
+{
+	__sync_bool_compare_and_swap(slot, thisenv->env_id, 0);
+}
+
+// Wait on '*slot' until the other end makes progress, while
+// 'blocked' says there is nothing to do.  Falls back to yielding if
+// another environment is already waiting on this end.  Other IPCs that
+// arrive meanwhile, aio replies included, are handled by aio_ipc_wait.
+static void
+pipe_wait(struct Fd *fd, struct Pipe *p, volatile envid_t *slot,
+	  bool (*blocked)(struct Pipe *))
+{
+	int r;
+
+	if (!__sync_bool_compare_and_swap(slot, 0, thisenv->env_id)) {
+		sys_yield();
+		return;
+	}
+	__sync_synchronize();
+	if (!blocked(p) || _pipeisclosed(fd, p))
+		pipe_unwait(slot);
+	else if ((r = aio_ipc_wait(PIPE_WAKEUP, PIPE_WAIT_MSEC)) < 0) {
+		pipe_unwait(slot);
+		// No room to put other IPCs aside: poll until there is
+		if (r == -E_NO_MEM)
+			sys_yield();
+	}
+}
+
+static bool
+pipe_empty(struct Pipe *p)
+{
+	return pipe_used(p) == 0;
+}
+
+static bool
+pipe_full(struct Pipe *p)
+{
+	return pipe_used(p) == PIPEBUFSIZ;
+}
+
 static ssize_t
 devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 {
-	uint8_t *buf;
-	size_t i;
 	struct Pipe *p;
+	envid_t w;
+	size_t i;
 
 	p = (struct Pipe*)fd2data(fd);
 	if (debug)
 		cprintf("[%08x] devpipe_read %08x %d rpos %d wpos %d\n",
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
-	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_rpos == p->p_wpos) {
-			// pipe is empty
-			// if we got any data, return it
-			if (i > 0)
-				return i;
-			// if all the writers are gone, note eof
-			if (_pipeisclosed(fd, p))
-				return 0;
-			// yield and see what happens
-			if (debug)
-				cprintf("devpipe_read yield\n");
-			sys_yield();
-		}
-		// there's a byte.  take it.
-		// wait to increment rpos until the byte is taken!
-		buf[i] = p->p_buf[p->p_rpos % PIPEBUFSIZ];
-		p->p_rpos++;
+	if (n == 0)
+		return 0;
+	while (pipe_empty(p)) {
+		// if all the writers are gone, note eof
+		if (_pipeisclosed(fd, p))
+			return 0;
+		if (debug)
+			cprintf("devpipe_read wait\n");
+		pipe_wait(fd, p, &p->p_rwait, pipe_empty);
 	}
+	// return whatever has arrived, and let a blocked writer fill
+	// the room we made
+	i = pipe_get(p, vbuf, n);
+	__sync_synchronize();
+	if ((w = pipe_claim(&p->p_wwait)))
+		pipe_wake(w);
 	return i;
 }
 
@@ -140,8 +269,9 @@ static ssize_t
 devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 {
 	const uint8_t *buf;
-	size_t i;
 	struct Pipe *p;
+	envid_t w;
+	size_t i;
 
 	p = (struct Pipe*) fd2data(fd);
 	if (debug)
@@ -149,43 +279,105 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_wpos >= p->p_rpos + sizeof(p->p_buf)) {
-			// pipe is full
+	for (i = 0; i < n; ) {
+		while (pipe_full(p)) {
 			// if all the readers are gone
 			// (it's only writers like us now),
 			// note eof
 			if (_pipeisclosed(fd, p))
 				return 0;
-			// yield and see what happens
 			if (debug)
-				cprintf("devpipe_write yield\n");
-			sys_yield();
+				cprintf("devpipe_write wait\n");
+			pipe_wait(fd, p, &p->p_wwait, pipe_full);
 		}
-		// there's room for a byte.  store it.
-		// wait to increment wpos until the byte is stored!
-		p->p_buf[p->p_wpos % PIPEBUFSIZ] = buf[i];
-		p->p_wpos++;
+		i += pipe_put(p, buf + i, n - i);
+		__sync_synchronize();
+		if ((w = pipe_claim(&p->p_rwait)))
+			pipe_wake(w);
 	}
 
 	return i;
 }
 
+// A pipe has no server to reply, so asynchronous operations are
+// polled by await_any through devpipe_await.
+static int
+devpipe_astart(struct Fd *fd, struct Aio *aio)
+{
+	aio->aio_server = 0;
+	return 0;
+}
+
+// Move whatever data (or room) the pipe has without blocking.
+// The operation is done once at least one byte moved or the other
+// end is closed.
+static int
+devpipe_await(struct Fd *fd, struct Aio *aio, int32_t value)
+{
+	struct Pipe *p;
+	envid_t w;
+	size_t i;
+
+	USED(value);
+	p = (struct Pipe*) fd2data(fd);
+	if (aio->aio_op == AIO_READ) {
+		i = pipe_get(p, aio->aio_buf, aio->aio_n);
+		w = i ? pipe_claim(&p->p_wwait) : 0;
+	} else {
+		i = pipe_put(p, aio->aio_buf, aio->aio_n);
+		w = i ? pipe_claim(&p->p_rwait) : 0;
+	}
+	if (w)
+		pipe_wake(w);
+	if (i == 0 && aio->aio_n > 0 && !_pipeisclosed(fd, p))
+		return 0;
+	aio->aio_result = i;
+	return 1;
+}
+
 static int
 devpipe_stat(struct Fd *fd, struct Stat *stat)
 {
 	struct Pipe *p = (struct Pipe*) fd2data(fd);
 	strcpy(stat->st_name, "<pipe>");
-	stat->st_size = p->p_wpos - p->p_rpos;
+	stat->st_size = pipe_used(p);
 	stat->st_isdir = 0;
 	stat->st_dev = &devpipe;
 	return 0;
 }
 
+static int
+devpipe_poll(struct Fd *fd, int events)
+{
+	struct Pipe *p = (struct Pipe*) fd2data(fd);
+	int revents = 0;
+
+	if ((events & POLLIN) && !pipe_empty(p))
+		revents |= POLLIN;
+	if ((events & POLLOUT) && !pipe_full(p))
+		revents |= POLLOUT;
+	// The other end is gone: reads return eof, writes fail
+	if (_pipeisclosed(fd, p))
+		revents |= POLLHUP;
+	return revents;
+}
+
 static int
 devpipe_close(struct Fd *fd)
 {
+	struct Pipe *p = (struct Pipe*) fd2data(fd);
+	envid_t rw, ww;
+	int r;
+
+	// Wake anyone waiting on the pipe once we are gone from it, so
+	// that they see it closed
+	rw = pipe_claim(&p->p_rwait);
+	ww = pipe_claim(&p->p_wwait);
 	(void) sys_page_unmap(0, fd);
-	return sys_page_unmap(0, fd2data(fd));
+	r = sys_page_unmap(0, p);
+	if (rw)
+		pipe_wake(rw);
+	if (ww)
+		pipe_wake(ww);
+	return r;
 }
-
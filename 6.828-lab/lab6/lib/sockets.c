@@ -5,6 +5,9 @@ static ssize_t devsock_read(struct Fd *fd, void *buf, size_t n);
 static ssize_t devsock_write(struct Fd *fd, const void *buf, size_t n);
 static int devsock_close(struct Fd *fd);
 static int devsock_stat(struct Fd *fd, struct Stat *stat);
+static int devsock_aread(struct Fd *fd, struct Aio *aio);
+static int devsock_awrite(struct Fd *fd, struct Aio *aio);
+static int devsock_await(struct Fd *fd, struct Aio *aio, int32_t value);
 
 struct Dev devsock =
 {
@@ -14,6 +17,9 @@ struct Dev devsock =
 	.dev_write =	devsock_write,
 	.dev_close =	devsock_close,
 	.dev_stat =	devsock_stat,
+	.dev_aread =	devsock_aread,
+	.dev_awrite =	devsock_awrite,
+	.dev_await =	devsock_await,
 };
 
 static int
@@ -103,6 +109,27 @@ listen(int s, int backlog)
 	return nsipc_listen(r, backlog);
 }
 
+// Send at most 'count' bytes of the open file 'in_fd', starting at
+// 'offset', on the socket 'out_sock'.  The network server maps the
+// file's pages out of the file server's block cache, so the data is
+// never copied through this environment or the IPC pages; only lwIP
+// copies it, into its send buffers.  The seek position
+// of 'in_fd' is left alone.  Returns the number of bytes sent.
+int
+sendfile(int out_sock, int in_fd, off_t offset, size_t count)
+{
+	struct Fd *fd;
+	int r, s;
+
+	if ((s = fd2sockid(out_sock)) < 0)
+		return s;
+	if ((r = fd_lookup(in_fd, &fd)) < 0)
+		return r;
+	if (fd->fd_dev_id != devfile.dev_id)
+		return -E_NOT_SUPP;
+	return nsipc_sendfile(s, fd->fd_file.id, offset, count);
+}
+
 static ssize_t
 devsock_read(struct Fd *fd, void *buf, size_t n)
 {
@@ -112,9 +139,42 @@ devsock_read(struct Fd *fd, void *buf, size_t n)
 static ssize_t
 devsock_write(struct Fd *fd, const void *buf, size_t n)
 {
+	// Send what fits in one request page; the caller sees a short write
+	n = MIN(n, PGSIZE - sizeof(struct Nsreq_send));
 	return nsipc_send(fd->fd_sock.sockid, buf, n, 0);
 }
 
+static int
+devsock_aread(struct Fd *fd, struct Aio *aio)
+{
+	aio->aio_server = nsipc_arecv(fd->fd_sock.sockid, aio->aio_page,
+				      aio->aio_n, 0);
+	return 0;
+}
+
+static int
+devsock_awrite(struct Fd *fd, struct Aio *aio)
+{
+	size_t n = MIN(aio->aio_n, PGSIZE - sizeof(struct Nsreq_send));
+
+	aio->aio_server = nsipc_asend(fd->fd_sock.sockid, aio->aio_page,
+				      aio->aio_buf, n, 0);
+	return 0;
+}
+
+static int
+devsock_await(struct Fd *fd, struct Aio *aio, int32_t value)
+{
+	union Nsipc *req = aio->aio_page;
+
+	if (aio->aio_op == AIO_READ && value > 0) {
+		assert(value <= aio->aio_n);
+		memmove(aio->aio_buf, req->recvRet.ret_buf, value);
+	}
+	aio->aio_result = value;
+	return 1;
+}
+
 static int
 devsock_stat(struct Fd *fd, struct Stat *stat)
 {
@@ -0,0 +1,403 @@
+#include <inc/lib.h>
+
+// Buffered streams on top of file descriptors.
+//
+// A FILE collects output in its buffer and hands it to write() only
+// when the buffer fills, at a newline if the stream is line buffered,
+// or on fflush.  Input is read a buffer at a time.  A stream is
+// fully buffered unless it is on the console, where it is line
+// buffered; stderr is unbuffered.  exit() flushes every stream.
+//
+// The buffer holds either input or output.  Switching a stream from
+// reading to writing drops whatever input it had not yet returned.
+
+#define F_OPEN		0x01	// slot is in use
+#define F_CANREAD	0x02	// opened for reading
+#define F_CANWRITE	0x04	// opened for writing
+#define F_READ		0x08	// buffer holds input
+#define F_WRITE		0x10	// buffer holds output
+#define F_EOF		0x20
+#define F_ERR		0x40
+
+struct FILE {
+	int f_fd;
+	int f_flags;
+	int f_mode;		// _IONBF, _IOLBF, _IOFBF, or -1 until first use
+	char *f_buf;
+	size_t f_size;		// size of f_buf
+	size_t f_pos;		// next byte to read or write in f_buf
+	size_t f_len;		// bytes of input in f_buf
+	char f_mybuf[BUFSIZ];
+};
+
+static FILE files[FOPEN_MAX] = {
+	{ .f_fd = 0, .f_flags = F_OPEN|F_CANREAD, .f_mode = -1 },
+	{ .f_fd = 1, .f_flags = F_OPEN|F_CANWRITE, .f_mode = -1 },
+	{ .f_fd = 2, .f_flags = F_OPEN|F_CANWRITE, .f_mode = _IONBF },
+};
+
+FILE *const stdin = &files[0];
+FILE *const stdout = &files[1];
+FILE *const stderr = &files[2];
+
+// Write all 'n' bytes, as write() may take fewer at a time.
+static ssize_t
+writeall(int fd, const void *buf, size_t n)
+{
+	ssize_t m;
+	size_t tot;
+
+	for (tot = 0; tot < n; tot += m)
+		if ((m = write(fd, (const char *) buf + tot, n - tot)) <= 0)
+			return m < 0 ? m : -E_NO_DISK;
+	return tot;
+}
+
+// Write out the buffered output of 'f', or drop its buffered input.
+// With 'f' null, flush every stream.
+int
+fflush(FILE *f)
+{
+	ssize_t r;
+	int i, err = 0;
+
+	if (f == NULL) {
+		for (i = 0; i < FOPEN_MAX; i++)
+			if ((files[i].f_flags & F_OPEN)
+			    && (r = fflush(&files[i])) < 0)
+				err = r;
+		return err;
+	}
+
+	if ((f->f_flags & F_WRITE) && f->f_pos > 0
+	    && (r = writeall(f->f_fd, f->f_buf, f->f_pos)) < 0) {
+		f->f_flags |= F_ERR;
+		err = r;
+	}
+	f->f_pos = f->f_len = 0;
+	return err;
+}
+
+// Make the buffer of 'f' hold data going in direction 'dir'.
+static int
+stream_dir(FILE *f, int dir)
+{
+	int r = 0;
+
+	if (f->f_flags & dir)
+		return 0;
+	if (!(f->f_flags & (dir == F_READ ? F_CANREAD : F_CANWRITE)))
+		return -E_INVAL;
+	if (f->f_mode < 0)
+		f->f_mode = iscons(f->f_fd) > 0 ? _IOLBF : _IOFBF;
+	if (!f->f_buf) {
+		f->f_buf = f->f_mybuf;
+		f->f_size = sizeof(f->f_mybuf);
+	}
+	if (f->f_flags & (F_READ|F_WRITE))
+		r = fflush(f);
+	f->f_flags = (f->f_flags & ~(F_READ|F_WRITE)) | dir;
+	return r;
+}
+
+// Finish an output call; 'nl' says whether it wrote a newline.
+static int
+stream_sync(FILE *f, bool nl)
+{
+	if (f->f_mode == _IONBF || (nl && f->f_mode == _IOLBF))
+		return fflush(f);
+	return 0;
+}
+
+static int
+putbyte(FILE *f, char c)
+{
+	int r;
+
+	if (f->f_pos == f->f_size && (r = fflush(f)) < 0)
+		return r;
+	f->f_buf[f->f_pos++] = c;
+	return 0;
+}
+
+static ssize_t
+stream_write(FILE *f, const void *buf, size_t n)
+{
+	const char *p = buf;
+	size_t m, tot;
+	ssize_t r;
+
+	if ((r = stream_dir(f, F_WRITE)) < 0)
+		return r;
+	for (tot = 0; tot < n; tot += m) {
+		if (f->f_pos == f->f_size && (r = fflush(f)) < 0)
+			return r;
+		// Whole buffers' worth go straight to the file
+		if (f->f_pos == 0 && n - tot >= f->f_size) {
+			if ((r = writeall(f->f_fd, p + tot, n - tot)) < 0) {
+				f->f_flags |= F_ERR;
+				return r;
+			}
+			return n;
+		}
+		m = MIN(n - tot, f->f_size - f->f_pos);
+		memmove(f->f_buf + f->f_pos, p + tot, m);
+		f->f_pos += m;
+	}
+	if ((r = stream_sync(f, f->f_mode == _IOLBF
+				&& memfind(p, '\n', n) != p + n)) < 0)
+		return r;
+	return n;
+}
+
+// Refill the input buffer of 'f'.
+static int
+stream_fill(FILE *f)
+{
+	ssize_t r;
+
+	// Whoever reads is probably answering a prompt on the console
+	if (f != stdout && (stdout->f_flags & F_WRITE)
+	    && stdout->f_mode == _IOLBF)
+		fflush(stdout);
+
+	f->f_pos = f->f_len = 0;
+	r = read(f->f_fd, f->f_buf, f->f_mode == _IONBF ? 1 : f->f_size);
+	if (r < 0) {
+		f->f_flags |= F_ERR;
+		return r;
+	}
+	if (r == 0) {
+		f->f_flags |= F_EOF;
+		return -E_EOF;
+	}
+	f->f_len = r;
+	return 0;
+}
+
+FILE *
+fdopen(int fdnum, const char *mode)
+{
+	struct Fd *fd;
+	FILE *f;
+	int flags;
+
+	if (fd_lookup(fdnum, &fd) < 0)
+		return NULL;
+	if (mode[0] == 'r')
+		flags = F_CANREAD;
+	else if (mode[0] == 'w' || mode[0] == 'a')
+		flags = F_CANWRITE;
+	else
+		return NULL;
+	if (strchr(mode, '+'))
+		flags = F_CANREAD|F_CANWRITE;
+
+	for (f = files; f < files + FOPEN_MAX; f++)
+		if (!(f->f_flags & F_OPEN)) {
+			memset(f, 0, offsetof(FILE, f_mybuf));
+			f->f_fd = fdnum;
+			f->f_flags = F_OPEN | flags;
+			f->f_mode = -1;
+			return f;
+		}
+	return NULL;
+}
+
+// Flush 'f' and close its file descriptor.
+int
+fclose(FILE *f)
+{
+	int r, r2;
+
+	r = fflush(f);
+	r2 = close(f->f_fd);
+	f->f_flags = 0;
+	f->f_buf = NULL;
+	return r < 0 ? r : r2;
+}
+
+// Choose how 'f' is buffered, and optionally give it 'buf' of 'size'
+// bytes to buffer in.  Only allowed before the first I/O on 'f'.
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (f->f_flags & (F_READ|F_WRITE))
+		return -E_INVAL;
+	if (mode != _IONBF && mode != _IOLBF && mode != _IOFBF)
+		return -E_INVAL;
+	if (buf && size == 0)
+		return -E_INVAL;
+	f->f_mode = mode;
+	if (buf) {
+		f->f_buf = buf;
+		f->f_size = size;
+	}
+	return 0;
+}
+
+int
+feof(FILE *f)
+{
+	return (f->f_flags & F_EOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+	return (f->f_flags & F_ERR) != 0;
+}
+
+// Returns the next byte of 'f', -E_EOF at end of file, or another
+// error.
+int
+fgetc(FILE *f)
+{
+	int r;
+
+	if ((r = stream_dir(f, F_READ)) < 0)
+		return r;
+	if (f->f_pos == f->f_len && (r = stream_fill(f)) < 0)
+		return r;
+	return (unsigned char) f->f_buf[f->f_pos++];
+}
+
+// Read a line of at most n-1 bytes, keeping its newline.
+// Returns NULL at end of file or on error.
+char *
+fgets(char *s, int n, FILE *f)
+{
+	int c, i;
+
+	for (i = 0; i < n - 1; ) {
+		if ((c = fgetc(f)) < 0)
+			break;
+		s[i++] = c;
+		if (c == '\n')
+			break;
+	}
+	if (i == 0 || ferror(f))
+		return NULL;
+	s[i] = '\0';
+	return s;
+}
+
+size_t
+fread(void *buf, size_t size, size_t nmemb, FILE *f)
+{
+	char *p = buf;
+	size_t n = size * nmemb, m, tot;
+	ssize_t r;
+
+	if (n == 0 || stream_dir(f, F_READ) < 0)
+		return 0;
+	for (tot = 0; tot < n; tot += m) {
+		if (f->f_pos == f->f_len) {
+			// Read big requests straight into the caller's buffer
+			if (n - tot >= f->f_size) {
+				if ((r = readn(f->f_fd, p + tot, n - tot)) < 0)
+					f->f_flags |= F_ERR;
+				else if (r < n - tot)
+					f->f_flags |= F_EOF;
+				if (r > 0)
+					tot += r;
+				break;
+			}
+			if (stream_fill(f) < 0)
+				break;
+		}
+		m = MIN(n - tot, f->f_len - f->f_pos);
+		memmove(p + tot, f->f_buf + f->f_pos, m);
+		f->f_pos += m;
+	}
+	return tot / size;
+}
+
+int
+fputc(int c, FILE *f)
+{
+	int r;
+
+	if ((r = stream_dir(f, F_WRITE)) < 0
+	    || (r = putbyte(f, c)) < 0
+	    || (r = stream_sync(f, c == '\n')) < 0)
+		return r;
+	return (unsigned char) c;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+	ssize_t r;
+
+	if ((r = stream_write(f, s, strlen(s))) < 0)
+		return r;
+	return 0;
+}
+
+size_t
+fwrite(const void *buf, size_t size, size_t nmemb, FILE *f)
+{
+	if (size == 0 || nmemb == 0 || stream_write(f, buf, size * nmemb) < 0)
+		return 0;
+	return nmemb;
+}
+
+struct bprintbuf {
+	FILE *f;
+	int cnt;	// bytes written
+	int error;	// first error that occurred
+	bool nl;	// wrote a newline
+};
+
+static void
+bputch(int ch, void *thunk)
+{
+	struct bprintbuf *b = (struct bprintbuf *) thunk;
+	int r;
+
+	if (b->error < 0)
+		return;
+	if ((r = putbyte(b->f, ch)) < 0) {
+		b->error = r;
+		return;
+	}
+	b->cnt++;
+	if (ch == '\n')
+		b->nl = 1;
+}
+
+// printf into the buffer of stream 'f'.  (fprintf writes to a file
+// descriptor with no buffering beyond the call.)
+int
+vbprintf(FILE *f, const char *fmt, va_list ap)
+{
+	struct bprintbuf b;
+	int r;
+
+	if ((r = stream_dir(f, F_WRITE)) < 0)
+		return r;
+	b.f = f;
+	b.cnt = 0;
+	b.error = 0;
+	b.nl = 0;
+	vprintfmt(bputch, &b, fmt, ap);
+	if (b.error < 0)
+		return b.error;
+	if ((r = stream_sync(f, b.nl)) < 0)
+		return r;
+	return b.cnt;
+}
+
+int
+bprintf(FILE *f, const char *fmt, ...)
+{
+	va_list ap;
+	int cnt;
+
+	va_start(ap, fmt);
+	cnt = vbprintf(f, fmt, ap);
+	va_end(ap);
+
+	return cnt;
+}
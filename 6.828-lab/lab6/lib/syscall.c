@@ -2,12 +2,59 @@
 
 #include <inc/syscall.h>
 #include <inc/lib.h>
+#include <inc/x86.h>
+
+// Whether to make system calls with SYSENTER: -1 until we have
+// asked the CPU, then 0 or 1.
+static int use_sysenter = -1;
+
+static bool
+have_sysenter(void)
+{
+	uint32_t edx;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	return (edx & CPUID_EDX_SEP) != 0;
+}
+
+// Make system calls with SYSENTER when 'on' and the CPU has it, or
+// always with int $T_SYSCALL.
+int
+sysenter_enable(bool on)
+{
+	if (on && !have_sysenter())
+		return -E_NOT_SUPP;
+	use_sysenter = on;
+	return 0;
+}
 
 static inline int32_t
 syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
 	int32_t ret;
 
+	if (use_sysenter < 0)
+		use_sysenter = have_sysenter();
+
+	// Fast system call: SYSENTER saves no return address or stack
+	// pointer, so pass them in SI and BP, with our own BP kept in DI.
+	// Nothing may be saved on the stack instead, since a forked
+	// child resumes on a copy of it taken later.  That leaves room
+	// for three parameters.  The kernel returns with SYSEXIT, which
+	// clobbers DX and CX.  See sysenter_handler in kern/trapentry.S.
+	if (use_sysenter && a4 == 0 && a5 == 0) {
+		asm volatile("movl %%ebp, %%edi\n\t"
+			     "movl %%esp, %%ebp\n\t"
+			     "leal 1f, %%esi\n\t"
+			     "sysenter\n"
+			     "1:\tmovl %%edi, %%ebp\n"
+			     : "=a" (ret), "+d" (a1), "+c" (a2)
+			     : "0" (num),
+			       "b" (a3)
+			     : "esi", "edi", "cc", "memory");
+		goto out;
+	}
+
 	// Generic system call: pass system call number in AX,
 	// up to five parameters in DX, CX, BX, DI, SI.
 	// Interrupt kernel with T_SYSCALL.
@@ -31,6 +78,7 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		       "S" (a5)
 		     : "cc", "memory");
 
+out:
 	if(check && ret > 0)
 		panic("syscall %d returned %d (> 0)", num, ret);
 
@@ -117,8 +165,62 @@ sys_ipc_recv(void *dstva)
 	return syscall(SYS_ipc_recv, 0, (uint32_t)dstva, 0, 0, 0, 0);
 }
 
-unsigned int
-sys_time_msec(void)
+int
+sys_ipc_recv_timeout(void *dstva, unsigned int msec)
+{
+	return syscall(SYS_ipc_recv_timeout, 0, (uint32_t)dstva, msec, 0, 0, 0);
+}
+
+int
+sys_net_transmit(const void *buf, size_t len)
+{
+	return syscall(SYS_net_transmit, 0, (uint32_t) buf, len, 0, 0, 0);
+}
+
+int
+sys_net_transmit_batch(const void *const *bufs, const size_t *lens, int n)
+{
+	return syscall(SYS_net_transmit_batch, 0, (uint32_t) bufs, (uint32_t) lens, n, 0, 0);
+}
+
+int
+sys_net_receive(void *buf, size_t len)
+{
+	return syscall(SYS_net_receive, 0, (uint32_t) buf, len, 0, 0, 0);
+}
+
+int
+sys_net_receive_page(void *va)
+{
+	return syscall(SYS_net_receive_page, 0, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_net_wait_receive(void)
+{
+	return syscall(SYS_net_wait_receive, 0, 0, 0, 0, 0, 0);
+}
+
+int
+sys_net_set_moderation(uint32_t itr, uint32_t rdtr, uint32_t radv)
+{
+	return syscall(SYS_net_set_moderation, 0, itr, rdtr, radv, 0, 0);
+}
+
+int
+sys_env_set_weight(envid_t envid, unsigned weight)
+{
+	return syscall(SYS_env_set_weight, 1, envid, weight, 0, 0, 0);
+}
+
+int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	return syscall(SYS_env_set_affinity, 1, envid, mask, 0, 0, 0);
+}
+
+int
+sys_sched_set_slice(unsigned msec)
 {
-	return (unsigned int) syscall(SYS_time_msec, 0, 0, 0, 0, 0, 0);
+	return syscall(SYS_sched_set_slice, 0, msec, 0, 0, 0, 0);
 }
@@ -0,0 +1,34 @@
+// Frames and rate reports shared by the transmit throughput tests.
+
+#include "ns.h"
+
+// Fill 'f' with test frame number 'i': a TEST_FRAMELEN broadcast that
+// QEMU's user-mode network drops without a reply.
+void
+test_fill_frame(void *buf, int i)
+{
+	uint8_t *f = buf;
+
+	memset(f, 0xff, 6);			// broadcast destination
+	memcpy(f + 6, "\x52\x54\x00\x12\x34\x56", 6);
+	f[12] = 0x88;				// local experimental ethertype
+	f[13] = 0xb5;
+	snprintf((char *) f + 14, TEST_FRAMELEN - 14, "Packet %05d", i);
+}
+
+// Report the rate at which 'npkts' frames went out since 'start', a
+// sys_time_msec() time, along with how many of some costly event
+// ('nevents' 'events') it took.
+void
+test_report(const char *test, const char *how, int npkts, int nevents,
+	    const char *events, unsigned start)
+{
+	unsigned ms = sys_time_msec() - start;
+
+	if (ms == 0)
+		ms = 1;
+	cprintf("%s: %s: %d packets, %d %s in %u ms, %u pkt/s, %u KB/s\n",
+		test, how, npkts, nevents, events, ms,
+		(uint32_t) ((uint64_t) npkts * 1000 / ms),
+		(uint32_t) ((uint64_t) npkts * TEST_FRAMELEN * 1000 / 1024 / ms));
+}
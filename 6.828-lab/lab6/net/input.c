@@ -13,4 +13,29 @@ input(envid_t ns_envid)
 	// Hint: When you IPC a page to the network server, it will be
 	// reading from it for a while, so don't immediately receive
 	// another packet in to the same physical page.
+	struct jif_pkt *pkt = &nsipcbuf.pkt;
+	int r;
+
+	if ((r = sys_page_alloc(0, pkt, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r);
+	while (1) {
+		// The driver swaps the empty page at pkt for the page the
+		// card received a frame into, already at pkt->jp_data.
+		r = sys_net_receive_page(pkt);
+		if (r == -E_AGAIN) {
+			// Sleep until the card interrupts, or poll if it can't
+			if (sys_net_wait_receive() < 0)
+				sys_yield();
+			continue;
+		}
+		if (r < 0)
+			panic("sys_net_receive_page: %e", r);
+		pkt->jp_len = r;
+		ipc_send(ns_envid, NSREQ_INPUT, pkt, PTE_P|PTE_U|PTE_W);
+
+		// The network server keeps the page we just sent, so put
+		// a fresh page under nsipcbuf for the next packet.
+		if ((r = sys_page_alloc(0, pkt, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+	}
 }
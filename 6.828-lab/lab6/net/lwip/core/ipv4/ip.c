@@ -183,6 +183,8 @@ ip_input(struct pbuf *p, struct netif *inp)
   int check_ip_src=1;
 #endif /* LWIP_DHCP */
 
+  PERF_START;
+
   IP_STATS_INC(ip.recv);
   snmp_inc_ipinreceives();
 
@@ -440,6 +442,7 @@ ip_input(struct pbuf *p, struct netif *inp)
     }
   }
 
+  PERF_STOP("ip_input");
   return ERR_OK;
 }
 
@@ -54,6 +54,8 @@
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
 
+#include "arch/perf.h"
+
 #include <string.h>
 
 /* Forward declarations.*/
@@ -417,6 +419,7 @@ tcp_output(struct tcp_pcb *pcb)
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
+  PERF_START;
 
   /* First, check if we are invoked by the TCP input processing
      code. If so, we do not output anything. Instead, we rely on the
@@ -486,6 +489,7 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* LWIP_NETIF_HWADDRHINT*/
     pbuf_free(p);
 
+    PERF_STOP("tcp_output");
     return ERR_OK;
   }
 
@@ -584,6 +588,7 @@ tcp_output(struct tcp_pcb *pcb)
   }
 
   pcb->flags &= ~TF_NAGLEMEMERR;
+  PERF_STOP("tcp_output");
   return ERR_OK;
 }
 
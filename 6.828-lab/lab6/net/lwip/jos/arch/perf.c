@@ -0,0 +1,30 @@
+#include <inc/lib.h>
+
+#include <arch/perf.h>
+
+static struct perf_counter counters[PERF_NCOUNTERS];
+static int ncounters;
+
+// Return the counter for stage 'name', allocating it on first use, or
+// NULL if the table is full.
+struct perf_counter *
+perf_counter(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ncounters; i++)
+	if (strncmp(counters[i].pc_name, name, PERF_NAMELEN - 1) == 0)
+	    return &counters[i];
+    if (ncounters == PERF_NCOUNTERS)
+	return NULL;
+    strncpy(counters[ncounters].pc_name, name, PERF_NAMELEN - 1);
+    return &counters[ncounters++];
+}
+
+// Point *store at the table and return how many counters are in use.
+int
+perf_counters(struct perf_counter **store)
+{
+    *store = counters;
+    return ncounters;
+}
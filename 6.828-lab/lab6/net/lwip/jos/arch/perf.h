@@ -1,7 +1,39 @@
 #ifndef LWIP_ARCH_PERF_H
 #define LWIP_ARCH_PERF_H
 
-#define PERF_START
-#define PERF_STOP(x)
+#include <inc/types.h>
+#include <inc/x86.h>
+
+/*
+ * Cycle accounting for the lwIP stages bracketed by PERF_START and
+ * PERF_STOP("stage").  A stage counts the calls that reach its
+ * PERF_STOP and the TSC cycles they took, including any stages they
+ * call in turn.  Sites sharing a name share a counter.  The network
+ * server hands them out with NSREQ_STATS.
+ */
+
+#define PERF_NCOUNTERS	16
+#define PERF_NAMELEN	16
+
+struct perf_counter {
+    char pc_name[PERF_NAMELEN];
+    uint32_t pc_calls;
+    uint64_t pc_cycles;
+};
+
+struct perf_counter *perf_counter(const char *name);
+int perf_counters(struct perf_counter **store);
+
+#define PERF_START	uint64_t __perf_start = read_tsc()
+#define PERF_STOP(x)							\
+    do {								\
+	static struct perf_counter *__perf_ctr;				\
+	if (!__perf_ctr)						\
+	    __perf_ctr = perf_counter(x);				\
+	if (__perf_ctr) {						\
+	    __perf_ctr->pc_calls++;					\
+	    __perf_ctr->pc_cycles += read_tsc() - __perf_start;	\
+	}								\
+    } while (0)
 
 #endif
@@ -10,9 +10,23 @@ static struct thread_context *cur_tc;
 static struct thread_queue thread_queue;
 static struct thread_queue kill_queue;
 
+/*
+ * Threads blocked in thread_wait are off the run queue.  All of them are
+ * on wait_list, where thread_wakeup finds them by address; those with a
+ * deadline are also on sleep_heap, a binary min-heap ordered by
+ * deadline, so finding the ones whose time is up costs nothing while
+ * none are.
+ */
+static LIST_HEAD(, thread_context) wait_list;
+static struct thread_context **sleep_heap;
+static int sleep_n, sleep_cap;
+
+static void thread_switch(void);
+
 void
 thread_init(void) {
     threadq_init(&thread_queue);
+    LIST_INIT(&wait_list);
     max_tid = 0;
 }
 
@@ -21,50 +35,155 @@ thread_id(void) {
     return cur_tc->tc_tid;
 }
 
+static void
+heap_set(int i, struct thread_context *tc)
+{
+    sleep_heap[i] = tc;
+    tc->tc_heap_idx = i;
+}
+
+static void
+heap_up(int i)
+{
+    struct thread_context *tc = sleep_heap[i];
+
+    while (i > 0 && sleep_heap[(i - 1) / 2]->tc_deadline > tc->tc_deadline) {
+	heap_set(i, sleep_heap[(i - 1) / 2]);
+	i = (i - 1) / 2;
+    }
+    heap_set(i, tc);
+}
+
+static void
+heap_down(int i)
+{
+    struct thread_context *tc = sleep_heap[i];
+    int c;
+
+    while ((c = 2 * i + 1) < sleep_n) {
+	if (c + 1 < sleep_n
+	    && sleep_heap[c + 1]->tc_deadline < sleep_heap[c]->tc_deadline)
+	    c++;
+	if (tc->tc_deadline <= sleep_heap[c]->tc_deadline)
+	    break;
+	heap_set(i, sleep_heap[c]);
+	i = c;
+    }
+    heap_set(i, tc);
+}
+
+static void
+heap_push(struct thread_context *tc)
+{
+    if (sleep_n == sleep_cap) {
+	int cap = sleep_cap ? 2 * sleep_cap : 16;
+	struct thread_context **h = realloc(sleep_heap, cap * sizeof(*h));
+	if (!h)
+	    panic("thread_wait: out of memory for the sleep heap");
+	sleep_heap = h;
+	sleep_cap = cap;
+    }
+    heap_set(sleep_n++, tc);
+    heap_up(sleep_n - 1);
+}
+
+static void
+heap_remove(struct thread_context *tc)
+{
+    struct thread_context *last;
+    int i = tc->tc_heap_idx;
+
+    tc->tc_heap_idx = -1;
+    if (--sleep_n == i)
+	return;
+    last = sleep_heap[sleep_n];
+    heap_set(i, last);
+    heap_up(i);
+    heap_down(last->tc_heap_idx);
+}
+
+// Make waiting thread 'tc' runnable again.
+static void
+thread_ready(struct thread_context *tc)
+{
+    LIST_REMOVE(tc, tc_wait_link);
+    if (tc->tc_heap_idx >= 0)
+	heap_remove(tc);
+    tc->tc_waiting = 0;
+    threadq_push(&thread_queue, tc);
+}
+
+// Wake every thread whose thread_wait deadline has passed.
+static void
+thread_wake_expired(void)
+{
+    uint32_t now;
+
+    if (sleep_n == 0)
+	return;
+    now = sys_time_msec();
+    while (sleep_n > 0 && sleep_heap[0]->tc_deadline <= now)
+	thread_ready(sleep_heap[0]);
+}
+
+// Return the earliest deadline of any waiting thread, or ~0 if none.
+// A server should block for at most this long when it has nothing
+// runnable, so that timed waits end on time.
+uint32_t
+thread_next_deadline(void)
+{
+    thread_wake_expired();
+    return sleep_n > 0 ? sleep_heap[0]->tc_deadline : ~0;
+}
+
 void
 thread_wakeup(volatile uint32_t *addr) {
-    struct thread_context *tc = thread_queue.tq_first;
-    while (tc) {
-	if (tc->tc_wait_addr == addr)
+    struct thread_context *tc, *next;
+
+    for (tc = LIST_FIRST(&wait_list); tc; tc = next) {
+	next = LIST_NEXT(tc, tc_wait_link);
+	if (tc->tc_wait_addr == addr) {
 	    tc->tc_wakeup = 1;
-	tc = tc->tc_queue_link;
+	    thread_ready(tc);
+	}
     }
 }
 
+// Block the current thread until thread_wakeup(addr) or until the
+// absolute time 'msec' (~0 for never).  Returns at once if *addr is
+// no longer 'val'.
 void
 thread_wait(volatile uint32_t *addr, uint32_t val, uint32_t msec) {
-    uint32_t s = sys_time_msec();
-    uint32_t p = s;
+    if (addr && *addr != val)
+	return;
+    if (msec != ~0 && msec <= sys_time_msec())
+	return;
 
     cur_tc->tc_wait_addr = addr;
     cur_tc->tc_wakeup = 0;
+    cur_tc->tc_waiting = 1;
+    cur_tc->tc_deadline = msec;
+    cur_tc->tc_heap_idx = -1;
+    LIST_INSERT_HEAD(&wait_list, cur_tc, tc_wait_link);
+    if (msec != ~0)
+	heap_push(cur_tc);
 
-    while (p < msec) {
-	if (p < s)
-	    break;
-	if (addr && *addr != val)
-	    break;
-	if (cur_tc->tc_wakeup)
-	    break;
-
-	thread_yield();
-	p = sys_time_msec();
-    }
+    thread_switch();
 
     cur_tc->tc_wait_addr = 0;
     cur_tc->tc_wakeup = 0;
 }
 
+// Return the number of threads ready to run besides the current one.
 int
 thread_wakeups_pending(void)
 {
-    struct thread_context *tc = thread_queue.tq_first;
+    struct thread_context *tc;
     int n = 0;
-    while (tc) {
-	if (tc->tc_wakeup)
-	    ++n;
-	tc = tc->tc_queue_link;
-    }
+
+    thread_wake_expired();
+    for (tc = thread_queue.tq_first; tc; tc = tc->tc_queue_link)
+	++n;
     return n;
 }
 
@@ -159,23 +278,44 @@ thread_halt() {
     exit();
 }
 
-void
-thread_yield(void) {
-    struct thread_context *next_tc = threadq_pop(&thread_queue);
+// Run the next runnable thread.  The current thread goes back on the
+// run queue unless it is waiting, in which case it stays off until
+// thread_wakeup or its deadline makes it runnable.
+static void
+thread_switch(void)
+{
+    struct thread_context *next_tc;
+
+    while (!(next_tc = threadq_pop(&thread_queue))) {
+	if (!cur_tc || !cur_tc->tc_waiting)
+	    return;
+	// Every thread is waiting.  Servers don't get here, since their
+	// main thread blocks in ipc_recv rather than in thread_wait, so
+	// just let other environments run until a deadline passes.
+	sys_yield();
+	thread_wake_expired();
+    }
 
-    if (!next_tc)
+    if (next_tc == cur_tc)
 	return;
 
     if (cur_tc) {
 	if (jos_setjmp(&cur_tc->tc_jb) != 0)
 	    return;
-	threadq_push(&thread_queue, cur_tc);
+	if (!cur_tc->tc_waiting)
+	    threadq_push(&thread_queue, cur_tc);
     }
 
     cur_tc = next_tc;
     jos_longjmp(&cur_tc->tc_jb, 1);
 }
 
+void
+thread_yield(void) {
+    thread_wake_expired();
+    thread_switch();
+}
+
 static void
 print_jb(struct thread_context *tc) {
     cprintf("jump buffer for thread %s:\n", tc->tc_name);
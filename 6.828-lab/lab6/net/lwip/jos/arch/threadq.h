@@ -3,6 +3,7 @@
 
 #include <arch/thread.h>
 #include <arch/setjmp.h>
+#include <arch/queue.h>
 
 #define THREAD_NUM_ONHALT 4
 enum { name_size = 32 };
@@ -25,6 +26,10 @@ struct thread_context {
     struct jos_jmp_buf	tc_jb;
     volatile uint32_t	*tc_wait_addr;
     volatile char	tc_wakeup;
+    char		tc_waiting;	/* off the run queue in thread_wait */
+    uint32_t		tc_deadline;	/* when thread_wait gives up */
+    int			tc_heap_idx;	/* position in the sleep heap, or -1 */
+    LIST_ENTRY(thread_context) tc_wait_link;
     void		(*tc_onhalt[THREAD_NUM_ONHALT])(thread_id_t);
     int			tc_nonhalt;
     struct thread_context *tc_queue_link;
@@ -44,13 +44,27 @@
 
 #include <netif/etharp.h>
 
-#define PKTMAP		0x10000000
-
 struct jif {
     struct eth_addr *ethaddr;
     envid_t envid;
 };
 
+/*
+ * Received packets are handed to lwIP as PBUF_REF pbufs that point
+ * straight into the page the input environment sent us.  lwIP may keep
+ * such a pbuf (queued on a socket, say) after jif_input returns, so we
+ * hold a reference to each one ourselves and only give the page back
+ * once ours is the last reference.  When every slot is busy, or the
+ * caller is short of pages, we fall back to copying into a PBUF_POOL
+ * pbuf.
+ */
+#define JIF_NREF	10
+
+static struct jif_ref {
+    struct pbuf *p;
+    void *va;
+} jif_refs[JIF_NREF];
+
 static void
 low_level_init(struct netif *netif)
 {
@@ -80,14 +94,17 @@ low_level_init(struct netif *netif)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-    int r = sys_page_alloc(0, (void *)PKTMAP, PTE_U|PTE_W|PTE_P);
-    if (r < 0)
-	panic("jif: could not allocate page of memory");
-    struct jif_pkt *pkt = (struct jif_pkt *)PKTMAP;
+    struct jif_txring *ring = (struct jif_txring *)JIF_TXRING;
+    struct jif_pkt *pkt;
 
     struct jif *jif;
     jif = netif->state;
 
+    /* The output environment frees slots as the card takes the frames */
+    while (ring->jr_prod - ring->jr_cons == JIF_TXRING_NSLOTS)
+	sys_yield();
+    pkt = JIF_TXRING_SLOT(ring, ring->jr_prod);
+
     char *txbuf = pkt->jp_data;
     int txsize = 0;
     struct pbuf *q;
@@ -96,7 +113,7 @@ low_level_output(struct netif *netif, struct pbuf *p)
 	   time. The size of the data in each pbuf is kept in the ->len
 	   variable. */
 
-	if (txsize + q->len > 2000)
+	if (txsize + q->len > JIF_TXRING_SLOTSIZE - sizeof(pkt->jp_len))
 	    panic("oversized packet, fragment %d txsize %d\n", q->len, txsize);
 	memcpy(&txbuf[txsize], q->payload, q->len);
 	txsize += q->len;
@@ -104,8 +121,16 @@ low_level_output(struct netif *netif, struct pbuf *p)
 
     pkt->jp_len = txsize;
 
-    ipc_send(jif->envid, NSREQ_OUTPUT, (void *)pkt, PTE_P|PTE_W|PTE_U);
-    sys_page_unmap(0, (void *)pkt);
+    /* Publish the frame, then wake the output environment only if it
+       went to sleep on an empty ring; otherwise it will find this frame
+       in the same batch as the ones before it. */
+    asm volatile("" ::: "memory");
+    ring->jr_prod++;
+    __sync_synchronize();
+    if (ring->jr_sleeping) {
+	ring->jr_sleeping = 0;
+	ipc_send(jif->envid, NSREQ_OUTPUT_RING, NULL, 0);
+    }
 
     return ERR_OK;
 }
@@ -145,6 +170,40 @@ low_level_input(void *va)
 
     return p;
 }
+
+/*
+ * low_level_input_ref():
+ *
+ * Wrap the packet at va in a PBUF_REF pbuf and record it in a free
+ * jif_refs slot, or return NULL if there is no free slot.
+ *
+ */
+static struct pbuf *
+low_level_input_ref(void *va, struct jif_ref **ref_store)
+{
+    struct jif_pkt *pkt = (struct jif_pkt *)va;
+    struct jif_ref *ref;
+    struct pbuf *p;
+
+    for (ref = jif_refs; ref < jif_refs + JIF_NREF; ref++)
+	if (!ref->p)
+	    break;
+    if (ref == jif_refs + JIF_NREF)
+	return 0;
+
+    p = pbuf_alloc(PBUF_RAW, pkt->jp_len, PBUF_REF);
+    if (p == 0)
+	return 0;
+    p->payload = pkt->jp_data;
+
+    // This reference is ours; the one pbuf_alloc made goes to lwIP.
+    pbuf_ref(p);
+    ref->p = p;
+    ref->va = va;
+    *ref_store = ref;
+    return p;
+}
+
 /*
  * jif_output():
  *
@@ -166,26 +225,33 @@ jif_output(struct netif *netif, struct pbuf *p,
  * jif_input():
  *
  * This function should be called when a packet is ready to be read
- * from the interface. It uses the function low_level_input() that
- * should handle the actual reception of bytes from the network
- * interface.
+ * from the interface. It uses the function low_level_input_ref() or,
+ * failing that or if the caller cannot spare the page (may_keep is 0),
+ * low_level_input() to turn the packet page at va into a pbuf.
+ *
+ * Returns 1 if lwIP still refers to the page, in which case the caller
+ * must leave it mapped until jif_reclaim hands it back, or 0 if the
+ * page can be released right away.
  *
  */
 
-void
-jif_input(struct netif *netif, void *va)
+int
+jif_input(struct netif *netif, void *va, int may_keep)
 {
     struct jif *jif;
     struct eth_hdr *ethhdr;
     struct pbuf *p;
+    struct jif_ref *ref = 0;
 
     jif = netif->state;
   
-    /* move received packet into a new pbuf */
-    p = low_level_input(va);
+    /* wrap the received packet in a pbuf, or copy it into one */
+    p = may_keep ? low_level_input_ref(va, &ref) : NULL;
+    if (p == NULL)
+	p = low_level_input(va);
 
     /* no packet could be read, silently ignore this */
-    if (p == NULL) return;
+    if (p == NULL) return 0;
     /* points to packet payload, which starts with an Ethernet header */
     ethhdr = p->payload;
 
@@ -207,6 +273,36 @@ jif_input(struct netif *netif, void *va)
     default:
 	pbuf_free(p);
     }
+
+    if (ref && ref->p->ref == 1) {
+	/* lwIP is already done with it */
+	pbuf_free(ref->p);
+	ref->p = 0;
+	return 0;
+    }
+    return ref != 0;
+}
+
+/*
+ * jif_reclaim():
+ *
+ * Hand every packet page that lwIP no longer refers to back to the
+ * caller through release().
+ *
+ */
+
+void
+jif_reclaim(void (*release)(void *va))
+{
+    struct jif_ref *ref;
+
+    for (ref = jif_refs; ref < jif_refs + JIF_NREF; ref++) {
+	if (ref->p && ref->p->ref == 1) {
+	    pbuf_free(ref->p);
+	    ref->p = 0;
+	    release(ref->va);
+	}
+    }
 }
 
 /*
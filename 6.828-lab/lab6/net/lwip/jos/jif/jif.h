@@ -1,4 +1,5 @@
 #include <lwip/netif.h>
 
-void	jif_input(struct netif *netif, void *va);
+int	jif_input(struct netif *netif, void *va, int may_keep);
+void	jif_reclaim(void (*release)(void *va));
 err_t	jif_init(struct netif *netif);
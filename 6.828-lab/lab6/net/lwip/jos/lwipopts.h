@@ -10,7 +10,9 @@ void *memcpy(void *dst, const void *src, size_t n);
 
 //#define NO_SYS 1
 
-#define LWIP_STATS		0
+// Counters for NSREQ_STATS, 32 bits wide so bulk transfers do not wrap
+#define LWIP_STATS		1
+#define LWIP_STATS_LARGE	1
 #define LWIP_STATS_DISPLAY	0
 #define LWIP_DHCP		1
 #define LWIP_COMPAT_SOCKETS	0
@@ -19,25 +21,53 @@ void *memcpy(void *dst, const void *src, size_t n);
 
 // Various tuning knobs, see:
 // http://lists.gnu.org/archive/html/lwip-users/2006-11/msg00007.html
+//
+// Build with "make LWIP_PROFILE=THROUGHPUT" (see net/lwip/Makefrag) for
+// bulk TCP transfers; user/tcpbench measures the difference.
 
 #define MEM_ALIGNMENT		4
 
-#define MEMP_NUM_PBUF		64
 #define MEMP_NUM_UDP_PCB	8
-#define MEMP_NUM_TCP_PCB	32
 #define MEMP_NUM_TCP_PCB_LISTEN	16
+#define MEMP_NUM_SYS_TIMEOUT    6
+
+#define PBUF_POOL_BUFSIZE	2000
+
+#define TCP_MSS			1460
+
+#ifdef LWIP_PROFILE_THROUGHPUT
+
+// This lwIP keeps windows in 16 bits and cannot do RFC 1323 window
+// scaling, so the most a connection can have in flight is a window
+// of whole segments just under 64KB, in each direction.
+#define TCP_WND			(44 * TCP_MSS)
+#define TCP_SND_BUF		(44 * TCP_MSS)
+#define TCP_SND_QUEUELEN	(2 * TCP_SND_BUF/TCP_MSS)
+
+#define MEMP_NUM_PBUF		128
+#define MEMP_NUM_TCP_PCB	64
+#define MEMP_NUM_TCP_SEG	(4 * TCP_SND_QUEUELEN)
+#define MEMP_NUM_NETBUF		256
+#define MEMP_NUM_NETCONN	64
+
+// Enough heap for 16 connections with full send buffers, and enough
+// pool buffers for 16 full receive windows
+#define MEM_SIZE		(16 * TCP_SND_BUF + 64 * 1024)
+#define PBUF_POOL_SIZE		1024
+
+#else
+
+#define MEMP_NUM_PBUF		64
+#define MEMP_NUM_TCP_PCB	32
 #define MEMP_NUM_TCP_SEG	TCP_SND_QUEUELEN// at least as big as TCP_SND_QUEUELEN
 #define MEMP_NUM_NETBUF		128
 #define MEMP_NUM_NETCONN	32
-#define MEMP_NUM_SYS_TIMEOUT    6
 
 #define PER_TCP_PCB_BUFFER	(16 * 4096)
 #define MEM_SIZE		(PER_TCP_PCB_BUFFER*MEMP_NUM_TCP_SEG + 4096*MEMP_NUM_TCP_SEG)
 
 #define PBUF_POOL_SIZE		512
-#define PBUF_POOL_BUFSIZE	2000
 
-#define TCP_MSS			1460
 #define TCP_WND			24000
 #define TCP_SND_BUF		(16 * TCP_MSS)
 // lwip prints a warning if TCP_SND_QUEUELEN < (2 * TCP_SND_BUF/TCP_MSS), 
@@ -45,6 +75,8 @@ void *memcpy(void *dst, const void *src, size_t n);
 #define TCP_SND_QUEUELEN	(2 * TCP_SND_BUF/TCP_MSS)
 //#define TCP_SND_QUEUELEN	16
 
+#endif
+
 // Print error messages when we run out of memory
 #define LWIP_DEBUG	1
 //#define TCP_DEBUG	LWIP_DBG_ON
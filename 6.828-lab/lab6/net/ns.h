@@ -5,18 +5,20 @@
 #define MASK "255.255.255.0"
 #define DEFAULT "10.0.2.2"
 
-#define TIMER_INTERVAL 250
-
 // Virtual address at which to receive page mappings containing client requests.
 #define QUEUE_SIZE	20
 #define REQVA		(0x0ffff000 - QUEUE_SIZE * PGSIZE)
 
-/* timer.c */
-void timer(envid_t ns_envid, uint32_t initial_to);
-
 /* input.c */
 void input(envid_t ns_envid);
 
+/* benchframe.c, for the tests only */
+#define TEST_FRAMELEN	1514
+void test_fill_frame(void *f, int i);
+void test_report(const char *test, const char *how, int npkts, int nevents,
+		 const char *events, unsigned start);
+
 /* output.c */
 void output(envid_t ns_envid);
+struct jif_txring *txring_alloc(void);
 
@@ -2,6 +2,52 @@
 
 extern union Nsipc nsipcbuf;
 
+// Map the transmit ring shared with the output environment.  Call this
+// before forking the output environment, which inherits the mapping.
+struct jif_txring *
+txring_alloc(void)
+{
+	struct jif_txring *ring = (struct jif_txring *) JIF_TXRING;
+	int i, r;
+
+	for (i = 0; i < JIF_TXRING_SIZE; i += PGSIZE)
+		if ((r = sys_page_alloc(0, (char *) ring + i,
+					PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+			panic("txring_alloc: %e", r);
+	return ring;
+}
+
+// Hand every frame queued in 'ring' to the driver, as few system calls
+// as the card's descriptor ring allows.
+static void
+txring_drain(struct jif_txring *ring)
+{
+	const void *bufs[JIF_TXRING_NSLOTS];
+	size_t lens[JIF_TXRING_NSLOTS];
+	struct jif_pkt *pkt;
+	uint32_t cons, n;
+	int i, r;
+
+	while ((n = ring->jr_prod - (cons = ring->jr_cons)) > 0) {
+		// Slots wrap around, so send at most up to the end of the ring
+		n = MIN(n, JIF_TXRING_NSLOTS - cons % JIF_TXRING_NSLOTS);
+		asm volatile("" ::: "memory");
+		for (i = 0; i < n; i++) {
+			pkt = JIF_TXRING_SLOT(ring, cons + i);
+			bufs[i] = pkt->jp_data;
+			lens[i] = pkt->jp_len;
+		}
+		while ((r = sys_net_transmit_batch(bufs, lens, n)) == -E_AGAIN)
+			sys_yield();
+		if (r < 0) {
+			cprintf("ns_output: dropping packet: %e\n", r);
+			r = 1;
+		}
+		// The kernel has copied the frames; free their slots
+		ring->jr_cons = cons + r;
+	}
+}
+
 void
 output(envid_t ns_envid)
 {
@@ -10,4 +56,42 @@ output(envid_t ns_envid)
 	// LAB 6: Your code here:
 	// 	- read a packet from the network server
 	//	- send the packet to the device driver
+	struct jif_pkt *pkt = &nsipcbuf.pkt;
+	struct jif_txring *ring = NULL;
+	envid_t whom;
+	int perm, r;
+
+	// Our parent may have set up a transmit ring for us
+	if ((uvpd[PDX(JIF_TXRING)] & PTE_P) && (uvpt[PGNUM(JIF_TXRING)] & PTE_P))
+		ring = (struct jif_txring *) JIF_TXRING;
+
+	while (1) {
+		if (ring) {
+			txring_drain(ring);
+			// Tell the server to wake us, then look once more in
+			// case a frame arrived before it could see the flag.
+			ring->jr_sleeping = 1;
+			__sync_synchronize();
+			if (ring->jr_prod != ring->jr_cons) {
+				ring->jr_sleeping = 0;
+				continue;
+			}
+		}
+
+		r = ipc_recv(&whom, pkt, &perm);
+		if (whom != ns_envid) {
+			cprintf("ns_output: unexpected ipc %d from %08x\n", r, whom);
+			continue;
+		}
+		if (r == NSREQ_OUTPUT_RING && ring)
+			continue;
+		if (r != NSREQ_OUTPUT || !(perm & PTE_P)) {
+			cprintf("ns_output: unexpected ipc %d from %08x\n", r, whom);
+			continue;
+		}
+		while ((r = sys_net_transmit(pkt->jp_data, pkt->jp_len)) == -E_AGAIN)
+			sys_yield();
+		if (r < 0)
+			cprintf("ns_output: dropping packet: %e\n", r);
+	}
 }
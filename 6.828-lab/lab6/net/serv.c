@@ -9,6 +9,7 @@
 #include <inc/ns.h>
 #include <inc/lib.h>
 
+#include <arch/perf.h>
 #include <arch/perror.h>
 #include <arch/thread.h>
 #include <lwip/sockets.h>
@@ -43,14 +44,40 @@ static struct timer_thread t_arp;
 static struct timer_thread t_tcpf;
 static struct timer_thread t_tcps;
 
-static envid_t timer_envid;
 static envid_t input_envid;
 static envid_t output_envid;
+static envid_t fs_envid;
+
+// The file server request in flight on behalf of a sendfile thread.
+// Only one is outstanding at a time; serve() stores the reply here.
+static struct {
+	volatile uint32_t busy;
+	volatile uint32_t done;
+	int32_t val;
+	void *pg;
+} fsreply;
 
 static bool buse[QUEUE_SIZE];
 static int next_i(int i) { return (i+1) % QUEUE_SIZE; }
 static int prev_i(int i) { return (i ? i-1 : QUEUE_SIZE-1); }
 
+// lwIP may only keep a received packet's buffer (see jif_input) while
+// at least this many others are free.  Requests that block, such as
+// accept, select or a read waiting for data, hold theirs meanwhile.
+#define QUEUE_RESERVE	(QUEUE_SIZE / 2)
+
+static void release_buffer(void *va);
+
+static int
+buffers_free(void) {
+	int i, n = 0;
+
+	for (i = 0; i < QUEUE_SIZE; i++)
+		if (!buse[i])
+			n++;
+	return n;
+}
+
 static void *
 get_buffer(void) {
 	void *va;
@@ -59,6 +86,13 @@ get_buffer(void) {
 	for (i = 0; i < QUEUE_SIZE; i++)
 		if (!buse[i]) break;
 
+	// Take back any pages lwIP has finished with
+	if (i == QUEUE_SIZE) {
+		jif_reclaim(release_buffer);
+		for (i = 0; i < QUEUE_SIZE; i++)
+			if (!buse[i]) break;
+	}
+
 	if (i == QUEUE_SIZE) {
 		panic("NS: buffer overflow");
 		return 0;
@@ -76,6 +110,13 @@ put_buffer(void *va) {
 	buse[i] = 0;
 }
 
+// Release a request page lwIP held on to after jif_input.
+static void
+release_buffer(void *va) {
+	sys_page_unmap(0, va);
+	put_buffer(va);
+}
+
 static void
 lwip_init(struct netif *nif, void *if_state,
 	  uint32_t init_addr, uint32_t init_mask, uint32_t init_gw)
@@ -160,21 +201,107 @@ serve_init(uint32_t ipaddr, uint32_t netmask, uint32_t gw)
 	cprintf("NS: TCP/IP initialized.\n");
 }
 
-static void
-process_timer(envid_t envid) {
-	uint32_t start, now, to;
+// Receive the next request into 'va'.  While a thread sleeps with a
+// deadline (the lwIP timers always do), wait no longer than that;
+// the receive then fails with -E_TIMEOUT and serve() runs the thread.
+static int32_t
+serve_recv(envid_t *whom, void *va, int *perm)
+{
+	uint32_t now, next;
 
-	if (envid != timer_envid) {
-		cprintf("NS: received timer interrupt from envid %x not timer env\n", envid);
-		return;
+	next = thread_next_deadline();
+	if (next == ~0)
+		return ipc_recv(whom, va, perm);
+	now = sys_time_msec();
+	return ipc_recv_timeout(whom, va, perm, next > now ? next - now : 1);
+}
+
+// Ask the file server to map the block cache page holding 'offset'
+// of the open file 'fileid'.  On success the page is left mapped at
+// one of our request buffers in *pg_store, and the number of file
+// bytes on it from 'offset' on is returned.
+static int
+fs_map(int fileid, off_t offset, void **pg_store)
+{
+	union Fsipc *req;
+	int r;
+
+	while (fsreply.busy)
+		thread_wait(&fsreply.busy, 1, (uint32_t) -1);
+	fsreply.busy = 1;
+	fsreply.done = 0;
+
+	req = get_buffer();
+	if ((r = sys_page_alloc(0, req, PTE_P|PTE_W|PTE_U)) < 0)
+		goto out;
+	req->map.req_fileid = fileid;
+	req->map.req_offset = offset;
+	ipc_send(fs_envid, FSREQ_MAP, req, PTE_P|PTE_W|PTE_U);
+	sys_page_unmap(0, req);
+
+	thread_wait(&fsreply.done, 0, (uint32_t) -1);
+	r = fsreply.val;
+	*pg_store = fsreply.pg;
+	if (r > 0 && !*pg_store)
+		r = -E_INVAL;
+out:
+	put_buffer(req);
+	fsreply.busy = 0;
+	thread_wakeup(&fsreply.busy);
+	return r;
+}
+
+// Send file data to a socket from pages mapped out of the file
+// server's block cache.  lwip_send still copies the data into lwIP's
+// own buffers (NETCONN_COPY), since the page is unmapped as soon as it
+// returns; what is saved is the copying through IPC pages and the
+// client.  Returns the number of bytes sent.
+static int
+serve_sendfile(struct Nsreq_sendfile *req)
+{
+	off_t off = req->req_offset;
+	size_t left = req->req_count;
+	int n, r = 0, sent = 0;
+	void *pg;
+
+	while (left > 0) {
+		if ((n = fs_map(req->req_fileid, off, &pg)) <= 0) {
+			r = n;
+			break;
+		}
+		r = lwip_send(req->req_s, (char *) pg + PGOFF(off),
+			      MIN((size_t) n, left), 0);
+		sys_page_unmap(0, pg);
+		put_buffer(pg);
+		if (r <= 0)
+			break;
+		off += r;
+		left -= r;
+		sent += r;
 	}
+	return sent ? sent : r;
+}
 
-	start = sys_time_msec();
-	thread_yield();
-	now = sys_time_msec();
+// Copy the stage timings and lwIP's own counters into 'ret'.
+// Returns the number of stages.
+static int
+serve_stats(struct Nsret_stats *ret)
+{
+	struct perf_counter *pc;
+	int i, n;
 
-	to = TIMER_INTERVAL - (now - start);
-	ipc_send(envid, to, 0, 0);
+	static_assert(PERF_NCOUNTERS <= ARRAY_SIZE(ret->ret_perf));
+	static_assert(sizeof(*ret) <= PGSIZE);
+
+	n = perf_counters(&pc);
+	for (i = 0; i < n; i++) {
+		strcpy(ret->ret_perf[i].name, pc[i].pc_name);
+		ret->ret_perf[i].calls = pc[i].pc_calls;
+		ret->ret_perf[i].cycles = pc[i].pc_cycles;
+	}
+	ret->ret_nperf = n;
+	ret->ret_lwip = lwip_stats;
+	return n;
 }
 
 struct st_args {
@@ -187,9 +314,9 @@ static void
 serve_thread(uint32_t a) {
 	struct st_args *args = (struct st_args *)a;
 	union Nsipc *req = args->req;
-	int r;
+	int r, keep = 0;
 
-	switch (args->reqno) {
+	switch (args->reqno & ~IPCREQ_ASYNC) {
 	case NSREQ_ACCEPT:
 	{
 		struct Nsret_accept ret;
@@ -230,8 +357,31 @@ serve_thread(uint32_t a) {
 		r = lwip_socket(req->socket.req_domain, req->socket.req_type,
 				req->socket.req_protocol);
 		break;
+	case NSREQ_SENDFILE:
+		r = serve_sendfile(&req->sendfile);
+		break;
+	case NSREQ_SELECT:
+	{
+		// Only this thread blocks; lwIP wakes it on socket events.
+		struct timeval tv;
+		tv.tv_sec = req->select.req_timeout / 1000;
+		tv.tv_usec = (req->select.req_timeout % 1000) * 1000;
+		r = lwip_select(req->select.req_maxfdp1,
+				&req->select.req_readset,
+				&req->select.req_writeset,
+				&req->select.req_exceptset,
+				req->select.req_timeout < 0 ? NULL : &tv);
+		break;
+	}
+	case NSREQ_STATS:
+		r = serve_stats(&req->statsRet);
+		break;
 	case NSREQ_INPUT:
-		jif_input(&nif, (void *)&req->pkt);
+		// lwIP refers to received packets in place, so the page
+		// may have to outlive this request (see jif_input).
+		jif_reclaim(release_buffer);
+		keep = jif_input(&nif, (void *)&req->pkt,
+				 buffers_free() >= QUEUE_RESERVE);
 		r = 0;
 		break;
 	default:
@@ -246,11 +396,17 @@ serve_thread(uint32_t a) {
 		perror(buf);
 	}
 
-	if (args->reqno != NSREQ_INPUT)
+	// An asynchronous client tells its replies apart by the request
+	// page, so hand that back with the reply.
+	if (args->reqno & IPCREQ_ASYNC)
+		ipc_send(args->whom, r, req, PTE_P|PTE_W|PTE_U);
+	else if (args->reqno != NSREQ_INPUT)
 		ipc_send(args->whom, r, 0, 0);
 
-	put_buffer(args->req);
-	sys_page_unmap(0, (void*) args->req);
+	if (!keep) {
+		put_buffer(args->req);
+		sys_page_unmap(0, (void*) args->req);
+	}
 	free(args);
 }
 
@@ -270,15 +426,24 @@ serve(void) {
 
 		perm = 0;
 		va = get_buffer();
-		reqno = ipc_recv((int32_t *) &whom, (void *) va, &perm);
+		reqno = serve_recv((int32_t *) &whom, (void *) va, &perm);
+		if (whom == 0 && reqno == -E_TIMEOUT) {
+			// a sleeping thread is due; the loop above runs it
+			put_buffer(va);
+			continue;
+		}
 		if (debug) {
 			cprintf("ns req %d from %08x\n", reqno, whom);
 		}
 
-		// first take care of requests that do not contain an argument page
-		if (reqno == NSREQ_TIMER) {
-			process_timer(whom);
-			put_buffer(va);
+		// replies from the file server belong to a sendfile thread
+		if (whom == fs_envid && fsreply.busy && !fsreply.done) {
+			fsreply.val = reqno;
+			fsreply.pg = (perm & PTE_P) ? va : NULL;
+			if (!fsreply.pg)
+				put_buffer(va);
+			fsreply.done = 1;
+			thread_wakeup(&fsreply.done);
 			continue;
 		}
 
@@ -318,15 +483,6 @@ umain(int argc, char **argv)
 
 	binaryname = "ns";
 
-	// fork off the timer thread which will send us periodic messages
-	timer_envid = fork();
-	if (timer_envid < 0)
-		panic("error forking");
-	else if (timer_envid == 0) {
-		timer(ns_envid, TIMER_INTERVAL);
-		return;
-	}
-
 	// fork off the input thread which will poll the NIC driver for input
 	// packets
 	input_envid = fork();
@@ -338,7 +494,8 @@ umain(int argc, char **argv)
 	}
 
 	// fork off the output thread that will send the packets to the NIC
-	// driver
+	// driver, sharing the transmit ring with it
+	txring_alloc();
 	output_envid = fork();
 	if (output_envid < 0)
 		panic("error forking");
@@ -347,6 +504,8 @@ umain(int argc, char **argv)
 		return;
 	}
 
+	fs_envid = ipc_find_env(ENV_TYPE_FS);
+
 	// lwIP requires a user threading library; start the library and jump
 	// into a thread to continue initialization.
 	thread_init();
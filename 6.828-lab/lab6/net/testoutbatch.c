@@ -0,0 +1,64 @@
+#include "ns.h"
+
+#ifndef TESTOUTBATCH_COUNT
+#define TESTOUTBATCH_COUNT 2000
+#endif
+
+static envid_t output_envid;
+
+static struct jif_pkt *pkt = (struct jif_pkt*)REQVA;
+
+void
+umain(int argc, char **argv)
+{
+	envid_t ns_envid = sys_getenvid();
+	struct jif_txring *ring;
+	unsigned start;
+	int i, r, ipcs;
+
+	binaryname = "testoutbatch";
+
+	ring = txring_alloc();
+	output_envid = fork();
+	if (output_envid < 0)
+		panic("error forking");
+	else if (output_envid == 0) {
+		output(ns_envid);
+		return;
+	}
+
+	// One page and one IPC per packet, as testoutput does
+	start = sys_time_msec();
+	for (i = 0; i < TESTOUTBATCH_COUNT; i++) {
+		if ((r = sys_page_alloc(0, pkt, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+		test_fill_frame(pkt->jp_data, i);
+		pkt->jp_len = TEST_FRAMELEN;
+		ipc_send(output_envid, NSREQ_OUTPUT, pkt, PTE_P|PTE_W|PTE_U);
+		sys_page_unmap(0, pkt);
+	}
+	test_report("testoutbatch", "page", TESTOUTBATCH_COUNT,
+		    TESTOUTBATCH_COUNT, "IPCs", start);
+
+	// Packets queued on the shared ring, as the network server does;
+	// the output environment only needs an IPC when it went idle.
+	start = sys_time_msec();
+	for (i = ipcs = 0; i < TESTOUTBATCH_COUNT; i++) {
+		while (ring->jr_prod - ring->jr_cons == JIF_TXRING_NSLOTS)
+			sys_yield();
+		test_fill_frame(JIF_TXRING_SLOT(ring, ring->jr_prod)->jp_data, i);
+		JIF_TXRING_SLOT(ring, ring->jr_prod)->jp_len = TEST_FRAMELEN;
+		asm volatile("" ::: "memory");
+		ring->jr_prod++;
+		__sync_synchronize();
+		if (ring->jr_sleeping) {
+			ring->jr_sleeping = 0;
+			ipc_send(output_envid, NSREQ_OUTPUT_RING, NULL, 0);
+			ipcs++;
+		}
+	}
+	while (ring->jr_cons != ring->jr_prod)
+		sys_yield();
+	test_report("testoutbatch", "ring", TESTOUTBATCH_COUNT, ipcs,
+		    "IPCs", start);
+}
@@ -0,0 +1,53 @@
+#include "ns.h"
+
+#ifndef TESTTPUT_COUNT
+#define TESTTPUT_COUNT 2000
+#endif
+
+#ifndef TESTTPUT_BATCH
+#define TESTTPUT_BATCH 32
+#endif
+
+static uint8_t frame[TESTTPUT_BATCH][TEST_FRAMELEN];
+
+void
+umain(int argc, char **argv)
+{
+	const void *bufs[TESTTPUT_BATCH];
+	size_t lens[TESTTPUT_BATCH];
+	unsigned start;
+	int i, n, r, batches;
+
+	binaryname = "testtput";
+
+	for (i = 0; i < TESTTPUT_BATCH; i++) {
+		test_fill_frame(frame[i], i);
+		bufs[i] = frame[i];
+		lens[i] = TEST_FRAMELEN;
+	}
+
+	// One frame per system call and per tail register write
+	start = sys_time_msec();
+	for (i = 0; i < TESTTPUT_COUNT; i++)
+		while ((r = sys_net_transmit(frame[i % TESTTPUT_BATCH], TEST_FRAMELEN)) < 0) {
+			if (r != -E_AGAIN)
+				panic("sys_net_transmit: %e", r);
+			sys_yield();
+		}
+	test_report("testtput", "single", TESTTPUT_COUNT, TESTTPUT_COUNT,
+		    "doorbells", start);
+
+	// Up to TESTTPUT_BATCH frames per system call and tail write
+	start = sys_time_msec();
+	for (i = batches = 0; i < TESTTPUT_COUNT; i += r) {
+		n = MIN(TESTTPUT_BATCH, TESTTPUT_COUNT - i);
+		while ((r = sys_net_transmit_batch(bufs, lens, n)) < 0) {
+			if (r != -E_AGAIN)
+				panic("sys_net_transmit_batch: %e", r);
+			sys_yield();
+		}
+		batches++;
+	}
+	test_report("testtput", "batch", TESTTPUT_COUNT, batches,
+		    "doorbells", start);
+}
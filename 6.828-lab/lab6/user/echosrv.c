@@ -14,26 +14,20 @@ die(char *m)
 	exit();
 }
 
-void
+#define MAXCLIENTS 16
+
+// Echo whatever has arrived on 'sock'.  Returns 0 once the client has
+// closed the connection, or < 0 if it failed.
+int
 handle_client(int sock)
 {
 	char buffer[BUFFSIZE];
-	int received = -1;
-	// Receive message
-	if ((received = read(sock, buffer, BUFFSIZE)) < 0)
-		die("Failed to receive initial bytes from client");
-
-	// Send bytes and check for more incoming data in loop
-	while (received > 0) {
-		// Send back received data
-		if (write(sock, buffer, received) != received)
-			die("Failed to send bytes to client");
-
-		// Check for more data
-		if ((received = read(sock, buffer, BUFFSIZE)) < 0)
-			die("Failed to receive additional bytes from client");
-	}
-	close(sock);
+	int received;
+
+	received = read(sock, buffer, BUFFSIZE);
+	if (received > 0 && write(sock, buffer, received) != received)
+		die("Failed to send bytes to client");
+	return received;
 }
 
 void
@@ -41,9 +35,8 @@ umain(int argc, char **argv)
 {
 	int serversock, clientsock;
 	struct sockaddr_in echoserver, echoclient;
-	char buffer[BUFFSIZE];
-	unsigned int echolen;
-	int received = 0;
+	struct pollfd fds[MAXCLIENTS + 1];
+	int i, nfds;
 
 	// Create the TCP socket
 	if ((serversock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
@@ -71,17 +64,41 @@ umain(int argc, char **argv)
 
 	cprintf("bound\n");
 
-	// Run until canceled
+	// Serve every connected client from one environment, echoing to
+	// whichever of them has data
+	fds[0].fd = serversock;
+	fds[0].events = POLLIN;
+	nfds = 1;
 	while (1) {
-		unsigned int clientlen = sizeof(echoclient);
-		// Wait for client connection
-		if ((clientsock =
-		     accept(serversock, (struct sockaddr *) &echoclient,
-			    &clientlen)) < 0) {
-			die("Failed to accept client connection");
+		// While every slot is taken, stop watching the listening
+		// socket (poll skips negative fds), or its pending
+		// connections would wake us over and over
+		fds[0].fd = nfds < MAXCLIENTS + 1 ? serversock : -1;
+		if (poll(fds, nfds, -1) < 0)
+			die("Failed to poll");
+
+		for (i = 1; i < nfds; i++) {
+			if (!fds[i].revents)
+				continue;
+			if (handle_client(fds[i].fd) <= 0) {
+				close(fds[i].fd);
+				fds[i--] = fds[--nfds];
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			unsigned int clientlen = sizeof(echoclient);
+			// Wait for client connection
+			if ((clientsock =
+			     accept(serversock, (struct sockaddr *) &echoclient,
+				    &clientlen)) < 0) {
+				die("Failed to accept client connection");
+			}
+			cprintf("Client connected: %s\n", inet_ntoa(echoclient.sin_addr));
+			fds[nfds].fd = clientsock;
+			fds[nfds].events = POLLIN;
+			nfds++;
 		}
-		cprintf("Client connected: %s\n", inet_ntoa(echoclient.sin_addr));
-		handle_client(clientsock);
 	}
 
 	close(serversock);
@@ -3,18 +3,53 @@
 #include <lwip/inet.h>
 
 #define PORT 80
-#define VERSION "0.1"
-#define HTTP_VERSION "1.0"
+#define VERSION "0.2"
+#define HTTP_VERSION "1.1"
 
 #define E_BAD_REQ	1000
 
 #define BUFFSIZE 512
 #define MAXPENDING 5	// Max connection requests
 
+// Connections are kept open between requests, so serve up to MAXCONN of
+// them at once with poll.  Each buffers up to REQBUFSIZE bytes of
+// requests, and is closed after KEEPALIVE_MSEC without one.
+#define MAXCONN		16
+#define REQBUFSIZE	2048
+#define KEEPALIVE_MSEC	5000
+
+// Generated page reporting what the server has done
+#define STATUS_URL	"/server-status"
+
+// Number of worker environments sharing the listening socket, which
+// 'httpd -w N' overrides.  Each serves its own connections.
+#ifndef HTTPD_WORKERS
+#define HTTPD_WORKERS	4
+#endif
+#define MAXWORKERS	8
+
+// Each worker caches up to CACHE_NENT files of at most CACHE_MAXFILE
+// bytes, together with their response headers.  An entry is trusted for
+// CACHE_MSEC before the file server is asked again.
+#define CACHE_NENT	16
+#define CACHE_MAXFILE	(16 * 1024)
+#define CACHE_MSEC	2000
+
 struct http_request {
 	int sock;
 	char *url;
 	char *version;
+	int keepalive;		// leave the connection open afterwards
+	int chunked;		// client understands chunked responses
+	char hdr[BUFFSIZE];	// response header being built
+	int hdrlen;
+};
+
+struct http_conn {
+	int sock;
+	int len;		// bytes of requests in buf
+	unsigned last;		// time of the last request
+	char buf[REQBUFSIZE];
 };
 
 struct responce_header {
@@ -38,6 +73,34 @@ struct error_messages errors[] = {
 	{404, "Not Found"},
 };
 
+struct cache_ent {
+	char *url;		// file's url, or NULL if the entry is free
+	char *resp;		// keep-alive response: header, then body
+	int hdrlen;		// length of the header in resp
+	int len;		// length of resp
+	char *hdr_close;	// header to use when closing the connection
+	unsigned filled;	// when the file was read
+	unsigned used;		// when the entry was last used
+};
+
+// State the workers share, on a PTE_SHARE page
+struct httpd_shared {
+	unsigned start;
+	int accepted;
+	int requests;
+	int accept_lock;	// held by the worker calling accept
+	int nworkers;
+	int load[MAXWORKERS];	// each worker's open connections
+};
+
+#define shared		((struct httpd_shared *) 0xA0000000)
+
+static struct http_conn conns[MAXCONN];
+static struct pollfd fds[MAXCONN + 1];
+static int nconns;
+static int worker;
+static struct cache_ent cache[CACHE_NENT];
+
 static void
 die(char *m)
 {
@@ -45,6 +108,18 @@ die(char *m)
 	exit();
 }
 
+// Write all 'n' bytes of 'buf', which may take more than one write.
+static int
+write_full(int sock, const void *buf, int n)
+{
+	int r, done;
+
+	for (done = 0; done < n; done += r)
+		if ((r = write(sock, (const char *) buf + done, n - done)) <= 0)
+			return -1;
+	return 0;
+}
+
 static void
 req_free(struct http_request *req)
 {
@@ -52,6 +127,24 @@ req_free(struct http_request *req)
 	free(req->version);
 }
 
+// Append to the response header, which send_header_fin sends in one
+// piece.
+static int
+hdr_printf(struct http_request *req, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(req->hdr + req->hdrlen, sizeof(req->hdr) - req->hdrlen,
+		      fmt, ap);
+	va_end(ap);
+	if (n < 0 || req->hdrlen + n >= sizeof(req->hdr))
+		panic("buffer too small!");
+	req->hdrlen += n;
+	return 0;
+}
+
 static int
 send_header(struct http_request *req, int code)
 {
@@ -65,35 +158,32 @@ send_header(struct http_request *req, int code)
 	if (h->code == 0)
 		return -1;
 
-	int len = strlen(h->header);
-	if (write(req->sock, h->header, len) != len) {
-		die("Failed to send bytes to client");
-	}
-
-	return 0;
+	return hdr_printf(req, "%s", h->header);
 }
 
 static int
 send_data(struct http_request *req, int fd)
 {
 	// LAB 6: Your code here.
-	panic("send_data not implemented");
+	struct Stat st;
+	off_t off;
+	int r;
+
+	if ((r = fstat(fd, &st)) < 0)
+		return r;
+
+	// Let the network server take the file straight from the file
+	// server's block cache instead of copying it through us.
+	for (off = 0; off < st.st_size; off += r)
+		if ((r = sendfile(req->sock, fd, off, st.st_size - off)) <= 0)
+			return -1;
+	return 0;
 }
 
 static int
 send_size(struct http_request *req, off_t size)
 {
-	char buf[64];
-	int r;
-
-	r = snprintf(buf, 64, "Content-Length: %ld\r\n", (long)size);
-	if (r > 63)
-		panic("buffer too small!");
-
-	if (write(req->sock, buf, r) != r)
-		return -1;
-
-	return 0;
+	return hdr_printf(req, "Content-Length: %ld\r\n", (long)size);
 }
 
 static const char*
@@ -106,56 +196,100 @@ mime_type(const char *file)
 static int
 send_content_type(struct http_request *req)
 {
-	char buf[128];
-	int r;
 	const char *type;
 
 	type = mime_type(req->url);
 	if (!type)
 		return -1;
 
-	r = snprintf(buf, 128, "Content-Type: %s\r\n", type);
-	if (r > 127)
-		panic("buffer too small!");
+	return hdr_printf(req, "Content-Type: %s\r\n", type);
+}
 
-	if (write(req->sock, buf, r) != r)
+static int
+send_header_fin(struct http_request *req)
+{
+	hdr_printf(req, "Connection: %s\r\n\r\n",
+		   req->keepalive ? "keep-alive" : "close");
+	if (write(req->sock, req->hdr, req->hdrlen) != req->hdrlen)
 		return -1;
 
 	return 0;
 }
 
+// Send 'n' bytes of a body whose length wasn't known up front: one
+// chunk if the client takes chunked responses, otherwise as they are
+// (the connection is then closed to end the body).  n == 0 ends it.
 static int
-send_header_fin(struct http_request *req)
+send_chunk(struct http_request *req, const char *data, int n)
 {
-	const char *fin = "\r\n";
-	int fin_len = strlen(fin);
+	char buf[BUFFSIZE + 16];
+	int len;
 
-	if (write(req->sock, fin, fin_len) != fin_len)
+	if (!req->chunked) {
+		if (n > 0 && write(req->sock, data, n) != n)
+			return -1;
+		return 0;
+	}
+	assert(n <= BUFFSIZE);
+	len = snprintf(buf, 16, "%x\r\n", n);
+	memmove(buf + len, data, n);
+	len += n;
+	buf[len++] = '\r';
+	buf[len++] = '\n';
+	if (write(req->sock, buf, len) != len)
 		return -1;
-
 	return 0;
 }
 
-// given a request, this function creates a struct http_request
+// Case-insensitively, does 'line' start with header 'name'?
+static int
+header_is(const char *line, const char *name)
+{
+	for (; *name; line++, name++)
+		if ((*line | 0x20) != (*name | 0x20))
+			return 0;
+	return 1;
+}
+
+// Parse the request at the start of 'request', which holds the 'len'
+// bytes received so far and may end in the middle of a request.
+// Returns the length of the request once its header is complete, 0 if
+// more has to be read, or -E_BAD_REQ.
 static int
-http_request_parse(struct http_request *req, char *request)
+http_request_parse(struct http_request *req, char *request, int len)
 {
 	const char *url;
 	const char *version;
-	int url_len, version_len;
+	char *start, *end, *line, *value;
+	int url_len, version_len, i;
 
 	if (!req)
 		return -1;
 
-	if (strncmp(request, "GET ", 4) != 0)
+	start = request;
+
+	if (strncmp(request, "GET ", MIN(len, 4)) != 0)
 		return -E_BAD_REQ;
 
+	// the header ends with an empty line
+	for (end = 0, i = 0; i < len && !end; i++)
+		if (request[i] == '\n') {
+			if (i + 1 < len && request[i + 1] == '\n')
+				end = request + i + 2;
+			else if (i + 2 < len && request[i + 1] == '\r'
+				 && request[i + 2] == '\n')
+				end = request + i + 3;
+		}
+	if (!end)
+		return 0;
+
 	// skip GET
 	request += 4;
 
 	// get the url
 	url = request;
-	while (*request && *request != ' ')
+	while (request < end && *request != ' ' && *request != '\r'
+	       && *request != '\n')
 		request++;
 	url_len = request - url;
 
@@ -164,10 +298,11 @@ http_request_parse(struct http_request *req, char *request)
 	req->url[url_len] = '\0';
 
 	// skip space
-	request++;
+	if (*request == ' ')
+		request++;
 
 	version = request;
-	while (*request && *request != '\n')
+	while (*request != '\r' && *request != '\n')
 		request++;
 	version_len = request - version;
 
@@ -175,16 +310,33 @@ http_request_parse(struct http_request *req, char *request)
 	memmove(req->version, version, version_len);
 	req->version[version_len] = '\0';
 
+	// HTTP/1.1 connections persist unless the client says otherwise
+	req->chunked = strcmp(req->version, "HTTP/1.1") == 0;
+	req->keepalive = req->chunked;
+
+	// headers, one per line
+	for (line = strchr(request, '\n') + 1; line < end;
+	     line = strchr(line, '\n') + 1) {
+		if (!header_is(line, "Connection:"))
+			continue;
+		for (value = line + 11; *value == ' '; value++)
+			;
+		if (header_is(value, "close"))
+			req->keepalive = 0;
+		else if (header_is(value, "keep-alive"))
+			req->keepalive = 1;
+	}
+
 	// no entity parsing
 
-	return 0;
+	return end - start;
 }
 
 static int
 send_error(struct http_request *req, int code)
 {
-	char buf[512];
-	int r;
+	char buf[512], body[128];
+	int r, n;
 
 	struct error_messages *e = errors;
 	while (e->code != 0 && e->msg != 0) {
@@ -196,13 +348,17 @@ send_error(struct http_request *req, int code)
 	if (e->code == 0)
 		return -1;
 
+	n = snprintf(body, 128, "<html><body><p>%d - %s</p></body></html>\r\n",
+		     e->code, e->msg);
 	r = snprintf(buf, 512, "HTTP/" HTTP_VERSION" %d %s\r\n"
 			       "Server: jhttpd/" VERSION "\r\n"
-			       "Connection: close"
+			       "Connection: %s\r\n"
 			       "Content-type: text/html\r\n"
-			       "\r\n"
-			       "<html><body><p>%d - %s</p></body></html>\r\n",
-			       e->code, e->msg, e->code, e->msg);
+			       "Content-Length: %d\r\n"
+			       "\r\n%s",
+			       e->code, e->msg,
+			       req->keepalive ? "keep-alive" : "close",
+			       n, body);
 
 	if (write(req->sock, buf, r) != r)
 		return -1;
@@ -210,12 +366,153 @@ send_error(struct http_request *req, int code)
 	return 0;
 }
 
+static int
+send_status(struct http_request *req)
+{
+	char buf[BUFFSIZE];
+	int i, r, n;
+
+	// Without chunking, the end of the body is the end of the connection
+	if (!req->chunked)
+		req->keepalive = 0;
+
+	if ((r = send_header(req, 200)) < 0
+	    || (r = send_content_type(req)) < 0)
+		return r;
+	if (req->chunked)
+		hdr_printf(req, "Transfer-Encoding: chunked\r\n");
+	if ((r = send_header_fin(req)) < 0)
+		return r;
+
+	n = snprintf(buf, sizeof(buf), "<html><body><pre>\r\n");
+	if ((r = send_chunk(req, buf, n)) < 0)
+		return r;
+	n = snprintf(buf, sizeof(buf),
+		     "uptime:      %u ms\r\n"
+		     "connections: %d accepted\r\n"
+		     "requests:    %d\r\n",
+		     sys_time_msec() - shared->start,
+		     shared->accepted, shared->requests);
+	if ((r = send_chunk(req, buf, n)) < 0)
+		return r;
+	for (i = 0; i < shared->nworkers; i++) {
+		n = snprintf(buf, sizeof(buf), "worker %d:    %d open\r\n",
+			     i, shared->load[i]);
+		if ((r = send_chunk(req, buf, n)) < 0)
+			return r;
+	}
+	n = snprintf(buf, sizeof(buf), "</pre></body></html>\r\n");
+	if ((r = send_chunk(req, buf, n)) < 0)
+		return r;
+	return send_chunk(req, NULL, 0);
+}
+
+// Return the fresh cache entry for 'url', or NULL.
+static struct cache_ent *
+cache_lookup(const char *url)
+{
+	unsigned now = sys_time_msec();
+	int i;
+
+	for (i = 0; i < CACHE_NENT; i++)
+		if (cache[i].url && strcmp(cache[i].url, url) == 0) {
+			if (now - cache[i].filled >= CACHE_MSEC)
+				return NULL;
+			cache[i].used = now;
+			return &cache[i];
+		}
+	return NULL;
+}
+
+// Cache the 'size'-byte file open as 'fd' under req->url, replacing any
+// stale entry for it or else the least recently used one.
+// Returns the entry, or NULL if the file couldn't be read or there is
+// no memory to cache it, in which case the caller serves it from the
+// file.
+static struct cache_ent *
+cache_fill(struct http_request *req, int fd, off_t size)
+{
+	struct cache_ent *c = &cache[0];
+	int i, hdrlen;
+
+	for (i = 0; i < CACHE_NENT; i++) {
+		if (cache[i].url && strcmp(cache[i].url, req->url) == 0) {
+			c = &cache[i];
+			break;
+		}
+		if (c->url && (!cache[i].url || cache[i].used < c->used))
+			c = &cache[i];
+	}
+	if (c->url) {
+		free(c->url);
+		free(c->resp);
+		free(c->hdr_close);
+		c->url = NULL;
+	}
+	c->resp = c->hdr_close = NULL;
+
+	// Build the header once with the usual helpers, in both variants
+	req->hdrlen = 0;
+	send_header(req, 200);
+	send_size(req, size);
+	send_content_type(req);
+	hdrlen = req->hdrlen;
+	hdr_printf(req, "Connection: close\r\n\r\n");
+	if (!(c->hdr_close = malloc(req->hdrlen + 1)))
+		goto fail;
+	strcpy(c->hdr_close, req->hdr);
+	req->hdrlen = hdrlen;
+	hdr_printf(req, "Connection: keep-alive\r\n\r\n");
+
+	c->hdrlen = req->hdrlen;
+	c->len = req->hdrlen + size;
+	if (!(c->resp = malloc(c->len)))
+		goto fail;
+	memmove(c->resp, req->hdr, c->hdrlen);
+	req->hdrlen = 0;
+	if (readn(fd, c->resp + c->hdrlen, size) != size)
+		goto fail;
+	if (!(c->url = malloc(strlen(req->url) + 1)))
+		goto fail;
+	strcpy(c->url, req->url);
+	c->filled = c->used = sys_time_msec();
+	return c;
+
+fail:
+	// Leave the header and the file as the caller found them
+	req->hdrlen = 0;
+	seek(fd, 0);
+	free(c->resp);
+	free(c->hdr_close);
+	c->resp = c->hdr_close = NULL;
+	return NULL;
+}
+
+static int
+send_cached(struct http_request *req, struct cache_ent *c)
+{
+	if (req->keepalive)
+		return write_full(req->sock, c->resp, c->len);
+	if (write_full(req->sock, c->hdr_close, strlen(c->hdr_close)) < 0)
+		return -1;
+	return write_full(req->sock, c->resp + c->hdrlen, c->len - c->hdrlen);
+}
+
 static int
 send_file(struct http_request *req)
 {
 	int r;
 	off_t file_size = -1;
 	int fd;
+	struct Stat st;
+	struct cache_ent *c;
+
+	if (strcmp(req->url, STATUS_URL) == 0)
+		return send_status(req);
+
+	// Hot files need neither the file server nor header formatting
+	if ((c = cache_lookup(req->url)))
+		return send_cached(req, c);
 
 	// open the requested url for reading
 	// if the file does not exist, send a 404 error using send_error
@@ -223,7 +520,21 @@ send_file(struct http_request *req)
 	// set file_size to the size of the file
 
 	// LAB 6: Your code here.
-	panic("send_file not implemented");
+	if ((fd = open(req->url, O_RDONLY)) < 0) {
+		send_error(req, 404);
+		return fd;
+	}
+	if ((r = fstat(fd, &st)) < 0 || st.st_isdir) {
+		send_error(req, 404);
+		r = -1;
+		goto end;
+	}
+	file_size = st.st_size;
+
+	if (file_size <= CACHE_MAXFILE && (c = cache_fill(req, fd, file_size))) {
+		r = send_cached(req, c);
+		goto end;
+	}
 
 	if ((r = send_header(req, 200)) < 0)
 		goto end;
@@ -244,50 +555,143 @@ end:
 	return r;
 }
 
-static void
-handle_client(int sock)
+// Serve every complete request 'c' has buffered, in order, so that
+// pipelined requests are answered without waiting to read again.
+// Returns 1 to keep the connection open or 0 to close it.
+static int
+handle_requests(struct http_conn *c)
 {
 	struct http_request con_d;
-	int r;
-	char buffer[BUFFSIZE];
-	int received = -1;
 	struct http_request *req = &con_d;
+	int r, keep = 1;
 
-	while (1)
-	{
-		// Receive message
-		if ((received = read(sock, buffer, BUFFSIZE)) < 0)
-			panic("failed to read");
-
+	while (keep && c->len > 0) {
 		memset(req, 0, sizeof(*req));
 
-		req->sock = sock;
+		req->sock = c->sock;
 
-		r = http_request_parse(req, buffer);
-		if (r == -E_BAD_REQ)
+		r = http_request_parse(req, c->buf, c->len);
+		if (r == 0) {
+			// a request longer than the buffer can't complete
+			if (c->len < sizeof(c->buf))
+				break;
+			r = -E_BAD_REQ;
+		}
+		if (r == -E_BAD_REQ) {
 			send_error(req, 400);
-		else if (r < 0)
+			return 0;
+		} else if (r < 0)
 			panic("parse failed");
-		else
-			send_file(req);
 
+		send_file(req);
+		__sync_fetch_and_add(&shared->requests, 1);
+		keep = req->keepalive;
 		req_free(req);
 
-		// no keep alive
-		break;
+		c->len -= r;
+		memmove(c->buf, c->buf + r, c->len);
 	}
+	return keep;
+}
+
+// Read whatever client 'c' has sent and answer it.
+// Returns 1 to keep the connection open or 0 to close it.
+static int
+handle_client(struct http_conn *c)
+{
+	int received;
+
+	// Receive message
+	if ((received = read(c->sock, c->buf + c->len,
+			     sizeof(c->buf) - c->len)) <= 0)
+		return 0;
+	c->len += received;
+	c->last = sys_time_msec();
+	return handle_requests(c);
+}
 
-	close(sock);
+static void
+close_conn(int i)
+{
+	close(conns[i].sock);
+	nconns--;
+	conns[i] = conns[nconns];
+	fds[i + 1] = fds[nconns + 1];
+	shared->load[worker] = nconns;
+}
+
+// Accept a connection waiting on 'serversock', unless another worker
+// gets to it first.  Workers with fewer connections get the first try.
+static void
+accept_conn(int serversock)
+{
+	static int deferred;
+	struct sockaddr_in client;
+	unsigned int clientlen = sizeof(client);
+	struct pollfd pfd;
+	int i, clientsock;
+
+	for (i = 0; i < shared->nworkers && !deferred; i++)
+		if (shared->load[i] < nconns) {
+			deferred = 1;
+			sys_yield();
+			return;
+		}
+	deferred = 0;
+
+	while (__sync_lock_test_and_set(&shared->accept_lock, 1))
+		sys_yield();
+	// Only accept if the connection is still there; accept would block
+	pfd.fd = serversock;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) > 0) {
+		// Wait for client connection
+		if ((clientsock = accept(serversock,
+					 (struct sockaddr *) &client,
+					 &clientlen)) < 0)
+		{
+			// Let the other workers keep serving
+			cprintf("Failed to accept client connection: %e\n",
+				clientsock);
+			goto out;
+		}
+		conns[nconns].sock = clientsock;
+		conns[nconns].len = 0;
+		conns[nconns].last = sys_time_msec();
+		fds[nconns + 1].fd = clientsock;
+		fds[nconns + 1].events = POLLIN;
+		nconns++;
+		shared->load[worker] = nconns;
+		__sync_fetch_and_add(&shared->accepted, 1);
+	}
+out:
+	__sync_lock_release(&shared->accept_lock);
 }
 
 void
 umain(int argc, char **argv)
 {
-	int serversock, clientsock;
-	struct sockaddr_in server, client;
+	int serversock;
+	struct sockaddr_in server;
+	struct Argstate args;
+	unsigned now;
+	int i, r, nworkers = HTTPD_WORKERS;
 
 	binaryname = "jhttpd";
 
+	argstart(&argc, argv, &args);
+	while ((i = argnext(&args)) >= 0)
+		switch (i) {
+		case 'w':
+			if (!argvalue(&args))
+				die("usage: httpd [-w workers]");
+			nworkers = strtol(argvalue(&args), 0, 0);
+			break;
+		default:
+			die("usage: httpd [-w workers]");
+		}
+	nworkers = MAX(1, MIN(nworkers, MAXWORKERS));
+
 	// Create the TCP socket
 	if ((serversock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
 		die("Failed to create socket");
@@ -309,18 +713,45 @@ umain(int argc, char **argv)
 	if (listen(serversock, MAXPENDING) < 0)
 		die("Failed to listen on server socket");
 
-	cprintf("Waiting for http connections...\n");
+	if ((r = sys_page_alloc(0, shared, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+		panic("sys_page_alloc: %e", r);
+	shared->start = sys_time_msec();
+	shared->nworkers = nworkers;
+
+	// Every worker inherits the listening socket
+	for (worker = 1; worker < nworkers; worker++)
+		if ((r = fork()) < 0)
+			panic("fork: %e", r);
+		else if (r == 0)
+			break;
+	if (worker == nworkers)
+		worker = 0;
+	else
+		binaryname = "jhttpd-worker";
 
+	if (worker == 0)
+		cprintf("Waiting for http connections...\n");
+
+	fds[0].fd = serversock;
+	fds[0].events = POLLIN;
 	while (1) {
-		unsigned int clientlen = sizeof(client);
-		// Wait for client connection
-		if ((clientsock = accept(serversock,
-					 (struct sockaddr *) &client,
-					 &clientlen)) < 0)
-		{
-			die("Failed to accept client connection");
+		// Stop accepting while every connection slot is busy
+		fds[0].fd = nconns < MAXCONN ? serversock : -1;
+		if (poll(fds, nconns + 1, nconns ? 1000 : -1) < 0)
+			die("Failed to poll");
+
+		now = sys_time_msec();
+		for (i = 0; i < nconns; i++) {
+			if (fds[i + 1].revents) {
+				if (handle_client(&conns[i]))
+					continue;
+			} else if (now - conns[i].last < KEEPALIVE_MSEC)
+				continue;
+			close_conn(i--);
 		}
-		handle_client(clientsock);
+
+		if (fds[0].revents & POLLIN)
+			accept_conn(serversock);
 	}
 
 	close(serversock);
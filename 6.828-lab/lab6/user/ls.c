@@ -47,24 +47,24 @@ ls1(const char *prefix, bool isdir, off_t size, const char *name)
 	const char *sep;
 
 	if(flag['l'])
-		printf("%11d %c ", size, isdir ? 'd' : '-');
+		bprintf(stdout, "%11d %c ", size, isdir ? 'd' : '-');
 	if(prefix) {
 		if (prefix[0] && prefix[strlen(prefix)-1] != '/')
 			sep = "/";
 		else
 			sep = "";
-		printf("%s%s", prefix, sep);
+		bprintf(stdout, "%s%s", prefix, sep);
 	}
-	printf("%s", name);
+	bprintf(stdout, "%s", name);
 	if(flag['F'] && isdir)
-		printf("/");
-	printf("\n");
+		fputc('/', stdout);
+	fputc('\n', stdout);
 }
 
 void
 usage(void)
 {
-	printf("usage: ls [-dFl] [file...]\n");
+	fputs("usage: ls [-dFl] [file...]\n", stdout);
 	exit();
 }
 
@@ -74,6 +74,10 @@ umain(int argc, char **argv)
 	int i;
 	struct Argstate args;
 
+	// Listings are not interactive; write them out in a few big pieces
+	// rather than a line at a time.  exit() flushes stdout.
+	setvbuf(stdout, NULL, _IOFBF, 0);
+
 	argstart(&argc, argv, &args);
 	while ((i = argnext(&args)) >= 0)
 		switch (i) {
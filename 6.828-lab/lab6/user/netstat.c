@@ -0,0 +1,79 @@
+// Print the network server's counters: cycles spent in each
+// instrumented lwIP stage, and lwIP's own per-protocol and memory
+// statistics.
+
+#include <inc/lib.h>
+#include <lwip/memp.h>
+
+static const char *memp_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc)	desc,
+#include <lwip/memp_std.h>
+};
+
+static struct Nsret_stats st;
+
+static void
+print_proto(const char *name, struct stats_proto *p)
+{
+	printf("%-8s %10u %10u %8u %8u %8u %8u\n", name,
+	       p->xmit, p->recv, p->drop, p->chkerr, p->memerr, p->err);
+}
+
+static void
+print_mem(const char *name, struct stats_mem *m)
+{
+	printf("%-16s %8u %8u %8u %8u\n", name,
+	       (unsigned) m->avail, (unsigned) m->used, (unsigned) m->max,
+	       m->err);
+}
+
+void
+umain(int argc, char **argv)
+{
+	int i, r;
+
+	binaryname = "netstat";
+
+	if ((r = nsipc_stats(&st)) < 0)
+		panic("nsipc_stats: %e", r);
+
+	printf("%-16s %10s %14s %10s\n", "stage", "calls", "cycles", "per call");
+	for (i = 0; i < st.ret_nperf; i++)
+		printf("%-16s %10u %14llu %10llu\n", st.ret_perf[i].name,
+		       st.ret_perf[i].calls, st.ret_perf[i].cycles,
+		       st.ret_perf[i].calls ?
+		       st.ret_perf[i].cycles / st.ret_perf[i].calls : 0);
+
+	printf("\n%-8s %10s %10s %8s %8s %8s %8s\n",
+	       "proto", "xmit", "recv", "drop", "chkerr", "memerr", "err");
+#if LINK_STATS
+	print_proto("LINK", &st.ret_lwip.link);
+#endif
+#if ETHARP_STATS
+	print_proto("ETHARP", &st.ret_lwip.etharp);
+#endif
+#if IPFRAG_STATS
+	print_proto("IP_FRAG", &st.ret_lwip.ip_frag);
+#endif
+#if IP_STATS
+	print_proto("IP", &st.ret_lwip.ip);
+#endif
+#if ICMP_STATS
+	print_proto("ICMP", &st.ret_lwip.icmp);
+#endif
+#if UDP_STATS
+	print_proto("UDP", &st.ret_lwip.udp);
+#endif
+#if TCP_STATS
+	print_proto("TCP", &st.ret_lwip.tcp);
+#endif
+
+	printf("\n%-16s %8s %8s %8s %8s\n", "memory", "avail", "used", "max", "err");
+#if MEM_STATS
+	print_mem("HEAP", &st.ret_lwip.mem);
+#endif
+#if MEMP_STATS
+	for (i = 0; i < MEMP_MAX; i++)
+		print_mem(memp_names[i], &st.ret_lwip.memp[i]);
+#endif
+}
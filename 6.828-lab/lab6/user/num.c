@@ -4,42 +4,43 @@ int bol = 1;
 int line = 0;
 
 void
-num(int f, const char *s)
+num(FILE *f, const char *s)
 {
-	long n;
-	int r;
-	char c;
+	int c, r;
 
-	while ((n = read(f, &c, 1)) > 0) {
+	while ((c = fgetc(f)) >= 0) {
 		if (bol) {
-			printf("%5d ", ++line);
+			bprintf(stdout, "%5d ", ++line);
 			bol = 0;
 		}
-		if ((r = write(1, &c, 1)) != 1)
+		if ((r = fputc(c, stdout)) < 0)
 			panic("write error copying %s: %e", s, r);
 		if (c == '\n')
 			bol = 1;
 	}
-	if (n < 0)
-		panic("error reading %s: %e", s, n);
+	if (c != -E_EOF)
+		panic("error reading %s: %e", s, c);
 }
 
 void
 umain(int argc, char **argv)
 {
+	FILE *in;
 	int f, i;
 
 	binaryname = "num";
 	if (argc == 1)
-		num(0, "<stdin>");
+		num(stdin, "<stdin>");
 	else
 		for (i = 1; i < argc; i++) {
 			f = open(argv[i], O_RDONLY);
 			if (f < 0)
 				panic("can't open %s: %e", argv[i], f);
+			else if (!(in = fdopen(f, "r")))
+				panic("can't buffer %s", argv[i]);
 			else {
-				num(f, argv[i]);
-				close(f);
+				num(in, argv[i]);
+				fclose(in);
 			}
 		}
 	exit();
@@ -0,0 +1,82 @@
+// Measure the latency of file server requests while environments spin
+// in the background, as the child in user/spin.c does, at the default
+// weight and then at the lowest one.
+//
+// Usage: schedbench [nspinners]
+
+#include <inc/lib.h>
+
+#define NREQ	200
+#define MAXSPIN	16
+
+static envid_t spinners[MAXSPIN];
+
+static void
+start_spinners(int n, unsigned weight)
+{
+	int i, r;
+
+	for (i = 0; i < n; i++) {
+		if ((spinners[i] = fork()) < 0)
+			panic("fork: %e", spinners[i]);
+		if (spinners[i] == 0)
+			while (1)
+				/* do nothing */;
+		if ((r = sys_env_set_weight(spinners[i], weight)) < 0)
+			panic("sys_env_set_weight: %e", r);
+	}
+}
+
+static void
+stop_spinners(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		sys_env_destroy(spinners[i]);
+}
+
+// Time NREQ stats, each an open and a stat request to the file server.
+static void
+measure(const char *what)
+{
+	struct Stat st;
+	uint64_t start, t, total = 0, worst = 0;
+	int i, r;
+
+	for (i = 0; i < NREQ; i++) {
+		start = time_usec();
+		if ((r = stat("/motd", &st)) < 0)
+			panic("stat /motd: %e", r);
+		t = time_usec() - start;
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+	printf("schedbench: %-24s %6u us mean, %6u us worst\n",
+	       what, (uint32_t) (total / NREQ), (uint32_t) worst);
+}
+
+void
+umain(int argc, char **argv)
+{
+	char what[32];
+	int nspin = 4;
+
+	if (argc > 1)
+		nspin = MIN(MAX(strtol(argv[1], 0, 0), 1), MAXSPIN);
+
+	measure("idle");
+
+	snprintf(what, sizeof what, "%d spinners, weight %d",
+		 nspin, ENV_WEIGHT_DEFAULT);
+	start_spinners(nspin, ENV_WEIGHT_DEFAULT);
+	measure(what);
+	stop_spinners(nspin);
+
+	snprintf(what, sizeof what, "%d spinners, weight %d",
+		 nspin, ENV_WEIGHT_MIN);
+	start_spinners(nspin, ENV_WEIGHT_MIN);
+	measure(what);
+	stop_spinners(nspin);
+}
@@ -0,0 +1,90 @@
+// Measure the string and memory routines in lib/string.c, in bytes per
+// cycle, for a range of sizes.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define MAXSIZE		(16 * 1024)
+#define BENCH_BYTES	(1 << 20)	// bytes to process per measurement
+
+static char buf1[MAXSIZE + 64] __attribute__((aligned(64)));
+static char buf2[MAXSIZE + 64] __attribute__((aligned(64)));
+static volatile int sink;
+
+enum { MEMMOVE, MEMMOVE_UNALIGNED, MEMSET, MEMCMP, STRLEN, STRCMP, NBENCH };
+
+static const char *bench_name[NBENCH] = {
+	"memmove", "memmove+1", "memset", "memcmp", "strlen", "strcmp"
+};
+
+static void
+run(int which, size_t n)
+{
+	switch (which) {
+	case MEMMOVE:
+		memmove(buf1, buf2, n);
+		break;
+	case MEMMOVE_UNALIGNED:
+		memmove(buf1 + 1, buf2 + 2, n);
+		break;
+	case MEMSET:
+		memset(buf1, 0x5a, n);
+		break;
+	case MEMCMP:
+		sink = memcmp(buf1, buf2, n);
+		break;
+	case STRLEN:
+		sink = strlen(buf1);
+		break;
+	case STRCMP:
+		sink = strcmp(buf1, buf2);
+		break;
+	}
+}
+
+// Bytes per cycle for 'which' on 'n' bytes, times 100
+static unsigned
+measure(int which, size_t n)
+{
+	uint64_t start, cycles;
+	unsigned i, iters = MAX(BENCH_BYTES / n, 16);
+
+	// Equal strings of n bytes, so that the compares run to the end
+	memset(buf1, 'x', n);
+	buf1[n] = '\0';
+	memmove(buf2, buf1, n + 1);
+
+	run(which, n);
+	start = read_tsc();
+	for (i = 0; i < iters; i++)
+		run(which, n);
+	cycles = read_tsc() - start;
+	if (cycles == 0)
+		cycles = 1;
+	return (uint64_t) n * iters * 100 / cycles;
+}
+
+void
+umain(int argc, char **argv)
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, MAXSIZE };
+	uint32_t edx;
+	unsigned r;
+	int i, j;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	printf("stringbench: bytes per cycle, SSE2 %s\n",
+	       (edx & CPUID_EDX_SSE2) ? "available" : "not available");
+	printf("%6s", "size");
+	for (j = 0; j < NBENCH; j++)
+		printf(" %10s", bench_name[j]);
+	printf("\n");
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		printf("%6d", sizes[i]);
+		for (j = 0; j < NBENCH; j++) {
+			r = measure(j, sizes[i]);
+			printf(" %7u.%02u", r / 100, r % 100);
+		}
+		printf("\n");
+	}
+}
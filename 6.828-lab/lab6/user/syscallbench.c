@@ -0,0 +1,42 @@
+// Measure the round trip of a null system call (sys_getenvid) made
+// with int $T_SYSCALL and with SYSENTER.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NCALLS	100000
+
+static uint64_t
+measure(void)
+{
+	uint64_t start;
+	int i;
+
+	sys_getenvid();
+	start = read_tsc();
+	for (i = 0; i < NCALLS; i++)
+		sys_getenvid();
+	return (read_tsc() - start) / NCALLS;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t slow, fast;
+	int r;
+
+	sysenter_enable(0);
+	slow = measure();
+	printf("syscallbench: int $%d: %u cycles per call\n",
+	       T_SYSCALL, (uint32_t) slow);
+
+	if ((r = sysenter_enable(1)) < 0) {
+		printf("syscallbench: sysenter: %e\n", r);
+		return;
+	}
+	fast = measure();
+	printf("syscallbench: sysenter: %u cycles per call\n", (uint32_t) fast);
+	if (fast)
+		printf("syscallbench: sysenter is %u.%02ux faster\n",
+		       (uint32_t) (slow / fast), (uint32_t) (slow * 100 / fast % 100));
+}
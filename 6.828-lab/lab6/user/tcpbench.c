@@ -0,0 +1,104 @@
+// TCP bulk transfer benchmark.  Listens on the echo port, which QEMU
+// forwards from the host (see "make which-ports").  For each client it
+// reads until the client shuts down its side, then sends TCPBENCH_BYTES
+// back and closes, reporting the rate in each direction.  The
+// tcpbench test in grade-lab6 is such a client.
+
+#include <inc/lib.h>
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+
+#define PORT 7
+
+#ifndef TCPBENCH_BYTES
+#define TCPBENCH_BYTES	(4 << 20)
+#endif
+
+#define BUFSIZE		8192
+
+static char buf[BUFSIZE];
+
+static void
+die(char *m)
+{
+	cprintf("%s\n", m);
+	exit();
+}
+
+static void
+report(const char *dir, uint32_t bytes, unsigned start)
+{
+	unsigned ms = sys_time_msec() - start;
+	uint32_t kbps;
+
+	if (ms == 0)
+		ms = 1;
+	// bits per millisecond are kbit/s
+	kbps = bytes / ms * 8 + bytes % ms * 8 / ms;
+	cprintf("tcpbench: %s %u bytes in %u ms, %u.%03u Mbit/s\n",
+		dir, bytes, ms, kbps / 1000, kbps % 1000);
+}
+
+static void
+bench(int sock)
+{
+	uint32_t total;
+	unsigned start;
+	int n;
+
+	// Receive: the timer starts with the first byte
+	if ((n = read(sock, buf, BUFSIZE)) <= 0)
+		return;
+	start = sys_time_msec();
+	total = n;
+	while ((n = read(sock, buf, BUFSIZE)) > 0)
+		total += n;
+	report("rx", total, start);
+
+	// Transmit
+	memset(buf, 'x', BUFSIZE);
+	start = sys_time_msec();
+	for (total = 0; total < TCPBENCH_BYTES; total += n) {
+		n = MIN(BUFSIZE, TCPBENCH_BYTES - total);
+		if ((n = write(sock, buf, n)) <= 0)
+			break;
+	}
+	report("tx", total, start);
+}
+
+void
+umain(int argc, char **argv)
+{
+	int serversock, clientsock;
+	struct sockaddr_in addr, client;
+	socklen_t clientlen;
+
+	binaryname = "tcpbench";
+
+	// What each connection can buffer, fixed by lwipopts.h
+	cprintf("tcpbench: window %d, send buffer %d, "
+		"%d bytes per connection, %d connections\n",
+		TCP_WND, TCP_SND_BUF, TCP_WND + TCP_SND_BUF, MEMP_NUM_TCP_PCB);
+
+	if ((serversock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		die("Failed to create socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(PORT);
+	if (bind(serversock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		die("Failed to bind the server socket");
+	if (listen(serversock, 1) < 0)
+		die("Failed to listen on server socket");
+
+	cprintf("bound\n");
+
+	while (1) {
+		clientlen = sizeof(client);
+		if ((clientsock = accept(serversock, (struct sockaddr *) &client,
+					 &clientlen)) < 0)
+			die("Failed to accept client connection");
+		bench(clientsock);
+		close(clientsock);
+	}
+}
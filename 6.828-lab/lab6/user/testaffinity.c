@@ -0,0 +1,55 @@
+// Test sys_env_set_affinity.  Run with CPUS=2: we move ourselves to
+// CPU 1, then pin a spinning child to CPU 0 and watch, through envs[],
+// that it only runs there.
+
+#include <inc/lib.h>
+
+#define SETTLE_MSEC	50
+#define WATCH_MSEC	200
+
+void
+umain(int argc, char **argv)
+{
+	const volatile struct Env *ce;
+	unsigned end, runs;
+	envid_t child;
+	int i, r;
+
+	if ((r = sys_env_set_affinity(0, 1 << 7)) != -E_INVAL)
+		panic("affinity for a missing CPU: got %e, not %e", r, -E_INVAL);
+	if ((r = sys_env_set_affinity(0, 1 << 1)) < 0)
+		panic("sys_env_set_affinity: %e (run with CPUS=2)", r);
+	for (i = 0; i < 10; i++) {
+		if (thisenv->env_cpunum != 1)
+			panic("pinned to CPU 1 but running on CPU %d",
+			      thisenv->env_cpunum);
+		sys_yield();
+	}
+	cprintf("self ok\n");
+
+	// The child inherits our affinity until we pin it elsewhere
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0)
+		while (1)
+			/* do nothing */;
+	if ((r = sys_env_set_affinity(child, 1 << 0)) < 0)
+		panic("sys_env_set_affinity child: %e", r);
+	ce = &envs[ENVX(child)];
+
+	// It moves at the end of its timeslice
+	end = sys_time_msec() + SETTLE_MSEC;
+	while ((int) (end - sys_time_msec()) > 0)
+		sys_yield();
+
+	runs = ce->env_runs;
+	end = sys_time_msec() + WATCH_MSEC;
+	while ((int) (end - sys_time_msec()) > 0)
+		if (ce->env_status == ENV_RUNNING && ce->env_cpunum != 0)
+			panic("child pinned to CPU 0 running on CPU %d",
+			      ce->env_cpunum);
+	if (ce->env_runs == runs)
+		panic("pinned child did not run");
+	sys_env_destroy(child);
+	cprintf("pin ok\n");
+}
@@ -0,0 +1,69 @@
+#include <inc/lib.h>
+
+char *msg = "Now is the time for all good men to come to the aid of their party.";
+
+// Read /lorem with several aread()s in flight at once while a child
+// feeds a pipe, and check both against their synchronous versions.
+void
+umain(int argc, char **argv)
+{
+	char abuf[4][512], sbuf[512], pbuf[100];
+	int fd[4], ids[4], p[2];
+	int i, j, r, pid, left;
+	ssize_t n;
+
+	binaryname = "testaio";
+
+	for (i = 0; i < 4; i++) {
+		if ((fd[i] = open("/lorem", O_RDONLY)) < 0)
+			panic("open /lorem: %e", fd[i]);
+		if ((r = seek(fd[i], i * sizeof(sbuf))) < 0)
+			panic("seek: %e", r);
+	}
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+	if ((pid = fork()) < 0)
+		panic("fork: %e", pid);
+	if (pid == 0) {
+		close(p[0]);
+		if ((r = write(p[1], msg, strlen(msg))) != strlen(msg))
+			panic("write: %e", r);
+		exit();
+	}
+	close(p[1]);
+
+	for (i = 0; i < 4; i++)
+		if ((ids[i] = aread(fd[i], abuf[i], sizeof(abuf[i]))) < 0)
+			panic("aread: %e", ids[i]);
+	if ((r = aread(p[0], pbuf, sizeof(pbuf) - 1)) < 0)
+		panic("aread pipe: %e", r);
+
+	for (left = 5; left > 0; left--) {
+		if ((r = await_any(&n)) < 0)
+			panic("await_any: %e", r);
+		if (n < 0)
+			panic("aio %d failed: %e", r, n);
+		for (j = 0; j < 4; j++)
+			if (ids[j] == r)
+				break;
+		if (j == 4) {
+			pbuf[n] = 0;
+			if (strncmp(pbuf, msg, n) != 0)
+				panic("pipe aread got %s", pbuf);
+			cprintf("pipe aread ok (%d bytes)\n", n);
+			continue;
+		}
+		if ((r = seek(fd[j], j * sizeof(sbuf))) < 0)
+			panic("seek: %e", r);
+		if ((r = readn(fd[j], sbuf, n)) != n)
+			panic("readn: got %d, want %d", r, n);
+		if (memcmp(abuf[j], sbuf, n) != 0)
+			panic("aread %d: data mismatch", j);
+		cprintf("file aread %d ok (%d bytes)\n", j, n);
+	}
+	if ((r = await_any(&n)) != -E_INVAL)
+		panic("await_any with nothing in flight returned %d", r);
+
+	wait(pid);
+	cprintf("testaio ok\n");
+}
@@ -1,5 +1,110 @@
 #include <inc/lib.h>
 
+// Live blocks in the stress test
+#define NSLOT		512
+#define NOPS		100000
+#define MAXSIZE		3000
+
+static struct {
+	uint8_t *p;
+	size_t n;
+} slot[NSLOT];
+
+static uint32_t seed = 1;
+
+static uint32_t
+rand(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// Sizes mostly small, as a server's are, with the odd large one
+static size_t
+rand_size(void)
+{
+	uint32_t r = rand();
+
+	if (r % 16 == 0)
+		return r / 16 % (4 * PGSIZE) + 1;
+	return r / 16 % MAXSIZE + 1;
+}
+
+static void
+fill(int i)
+{
+	memset(slot[i].p, i & 0xff, slot[i].n);
+}
+
+static void
+check(int i)
+{
+	size_t j;
+
+	for (j = 0; j < slot[i].n; j++)
+		if (slot[i].p[j] != (i & 0xff))
+			panic("block %d (%p, %d bytes) corrupt at %d",
+			      i, slot[i].p, slot[i].n, j);
+}
+
+// Random malloc, realloc and free over NSLOT live blocks, checking
+// every block's contents before it is freed or moved.
+static void
+stress(void)
+{
+	unsigned start, ms;
+	int i, op, nops[3] = { 0, 0, 0 };
+	size_t n;
+	uint8_t *p;
+
+	start = sys_time_msec();
+	for (op = 0; op < NOPS; op++) {
+		i = rand() % NSLOT;
+		if (!slot[i].p) {
+			slot[i].n = n = rand_size();
+			if (rand() % 2) {
+				if (!(slot[i].p = calloc(1, n)))
+					panic("calloc %d failed", n);
+				while (n > 0)
+					if (slot[i].p[--n] != 0)
+						panic("calloc gave dirty memory");
+			} else if (!(slot[i].p = malloc(n)))
+				panic("malloc %d failed", n);
+			fill(i);
+			nops[0]++;
+		} else if (rand() % 4 == 0) {
+			check(i);
+			n = rand_size();
+			if (!(p = realloc(slot[i].p, n)))
+				panic("realloc %d failed", n);
+			slot[i].p = p;
+			slot[i].n = MIN(slot[i].n, n);
+			check(i);
+			slot[i].n = n;
+			fill(i);
+			nops[1]++;
+		} else {
+			check(i);
+			free(slot[i].p);
+			slot[i].p = 0;
+			nops[2]++;
+		}
+	}
+	ms = sys_time_msec() - start;
+	for (i = 0; i < NSLOT; i++) {
+		if (slot[i].p)
+			check(i);
+		free(slot[i].p);
+		slot[i].p = 0;
+	}
+
+	if (ms == 0)
+		ms = 1;
+	printf("testmalloc: %d mallocs, %d reallocs, %d frees in %u ms, "
+	       "%u ops/s\n", nops[0], nops[1], nops[2], ms, NOPS * 1000 / ms);
+}
+
+// With "-s", run the stress test; otherwise take commands.
 void
 umain(int argc, char **argv)
 {
@@ -7,6 +112,11 @@ umain(int argc, char **argv)
 	int n;
 	void *v;
 
+	if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+		stress();
+		return;
+	}
+
 	while (1) {
 		buf = readline("> ");
 		if (buf == 0)
@@ -18,7 +128,14 @@ umain(int argc, char **argv)
 			n = strtol(buf + 7, 0, 0);
 			v = malloc(n);
 			printf("\t0x%x\n", (uintptr_t) v);
-		} else
+		} else if (memcmp(buf, "realloc ", 8) == 0) {
+			v = (void*) strtol(buf + 8, &buf, 0);
+			n = strtol(buf, 0, 0);
+			v = realloc(v, n);
+			printf("\t0x%x\n", (uintptr_t) v);
+		} else if (strcmp(buf, "stress") == 0)
+			stress();
+		else
 			printf("?unknown command\n");
 	}
 }
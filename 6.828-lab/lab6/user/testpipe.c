@@ -2,6 +2,49 @@
 
 char *msg = "Now is the time for all good men to come to the aid of their party.";
 
+#define TPUT_BYTES	(4 << 20)
+
+// Time moving TPUT_BYTES through a pipe from a child, a page at a time.
+static void
+throughput(void)
+{
+	static char buf[PGSIZE];
+	int i, n, pid, p[2];
+	unsigned start, ms, total;
+
+	binaryname = "pipethroughput";
+	if ((i = pipe(p)) < 0)
+		panic("pipe: %e", i);
+	if ((pid = fork()) < 0)
+		panic("fork: %e", pid);
+
+	if (pid == 0) {
+		close(p[0]);
+		memset(buf, 'x', sizeof buf);
+		for (total = 0; total < TPUT_BYTES; total += n)
+			if ((n = write(p[1], buf, MIN(sizeof buf, TPUT_BYTES - total))) <= 0)
+				panic("write: %e", n);
+		exit();
+	}
+
+	close(p[1]);
+	start = sys_time_msec();
+	for (total = 0; (n = read(p[0], buf, sizeof buf)) > 0; total += n)
+		if (buf[0] != 'x' || buf[n - 1] != 'x')
+			panic("bad data at %u", total);
+	if (n < 0)
+		panic("read: %e", n);
+	ms = sys_time_msec() - start;
+	close(p[0]);
+	wait(pid);
+	if (total != TPUT_BYTES)
+		panic("read %u bytes, not %u", total, TPUT_BYTES);
+	if (ms == 0)
+		ms = 1;
+	cprintf("pipe throughput: %u bytes in %u ms, %u KB/s\n",
+		total, ms, total / ms * 1000 / 1024);
+}
+
 void
 umain(int argc, char **argv)
 {
@@ -60,5 +103,7 @@ umain(int argc, char **argv)
 	close(p[1]);
 	wait(pid);
 
+	throughput();
+
 	cprintf("pipe tests passed\n");
 }
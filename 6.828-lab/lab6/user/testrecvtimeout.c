@@ -0,0 +1,37 @@
+// Test sys_ipc_recv_timeout: a receive with nobody sending times out
+// after its deadline, and one that gets a message does not.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	unsigned start, ms;
+	envid_t who, child;
+	int r;
+
+	if ((r = ipc_recv_timeout(&who, NULL, NULL, 0)) != -E_TIMEOUT)
+		panic("zero timeout: got %e, not %e", r, -E_TIMEOUT);
+
+	start = sys_time_msec();
+	if ((r = ipc_recv_timeout(&who, NULL, NULL, 200)) != -E_TIMEOUT)
+		panic("nobody sending: got %e, not %e", r, -E_TIMEOUT);
+	ms = sys_time_msec() - start;
+	if (ms < 200 || ms > 400)
+		panic("200 ms timeout took %u ms", ms);
+	if (who != 0)
+		panic("timed out receive from %08x", who);
+	cprintf("timeout ok\n");
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		ipc_send(thisenv->env_parent_id, 42, NULL, 0);
+		return;
+	}
+	if ((r = ipc_recv_timeout(&who, NULL, NULL, 5000)) != 42)
+		panic("receive from child: got %d", r);
+	if (who != child)
+		panic("received from %08x, not %08x", who, child);
+	cprintf("receive ok\n");
+}
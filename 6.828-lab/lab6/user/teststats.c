@@ -0,0 +1,73 @@
+// Test the per-environment counters at USTATS: make some system calls,
+// map some pages and exchange some messages, and check that
+// envstats[] counted exactly those.
+
+#include <inc/lib.h>
+
+#define NCALLS	10
+#define NPAGES	5
+#define NMSGS	3
+#define TESTVA	0xB0000000
+
+void
+umain(int argc, char **argv)
+{
+	const volatile struct EnvStats *es = &envstats[ENVX(thisenv->env_id)];
+	const volatile struct EnvStats *ces;
+	uint32_t calls, pages, sent, recvd;
+	envid_t child;
+	int i, r;
+
+	if (es->es_id != thisenv->env_id)
+		panic("envstats slot belongs to %08x", es->es_id);
+
+	calls = es->es_syscalls[SYS_getenvid];
+	for (i = 0; i < NCALLS; i++)
+		sys_getenvid();
+	if (es->es_syscalls[SYS_getenvid] - calls != NCALLS)
+		panic("%d getenvid calls counted as %u", NCALLS,
+		      es->es_syscalls[SYS_getenvid] - calls);
+	cprintf("syscalls ok\n");
+
+	pages = es->es_pages;
+	for (i = 0; i < NPAGES; i++)
+		if ((r = sys_page_alloc(0, (void *) (TESTVA + i * PGSIZE),
+					PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+	if (es->es_pages - pages != NPAGES)
+		panic("%d pages mapped counted as %u", NPAGES,
+		      es->es_pages - pages);
+	for (i = 0; i < NPAGES; i++)
+		sys_page_unmap(0, (void *) (TESTVA + i * PGSIZE));
+	if (es->es_pages != pages)
+		panic("%u pages mapped after unmapping, not %u",
+		      es->es_pages, pages);
+	cprintf("pages ok\n");
+
+	sent = es->es_ipc_sent;
+	recvd = es->es_ipc_recv;
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		for (i = 0; i < NMSGS; i++)
+			ipc_send(thisenv->env_parent_id, i, NULL, 0);
+		return;
+	}
+	for (i = 0; i < NMSGS; i++)
+		if ((r = ipc_recv(NULL, NULL, NULL)) != i)
+			panic("message %d: got %d", i, r);
+	if (es->es_ipc_recv - recvd != NMSGS || es->es_ipc_sent != sent)
+		panic("received %u and sent %u, not %d and 0",
+		      es->es_ipc_recv - recvd, es->es_ipc_sent - sent, NMSGS);
+
+	// The child's counters stay after it exits
+	wait(child);
+	ces = &envstats[ENVX(child)];
+	if (ces->es_id != child)
+		panic("child's envstats slot belongs to %08x", ces->es_id);
+	if (ces->es_ipc_sent != NMSGS)
+		panic("child sent %u, not %d", ces->es_ipc_sent, NMSGS);
+	if (ces->es_pages != 0)
+		panic("child exited with %u pages counted", ces->es_pages);
+	cprintf("ipc ok\n");
+}
@@ -0,0 +1,73 @@
+#include <inc/lib.h>
+
+#define NLINES	500
+
+static void
+write_lines(const char *what, FILE *f)
+{
+	int i, r;
+
+	for (i = 0; i < NLINES; i++)
+		if ((r = bprintf(f, "line %d of %d\n", i, NLINES)) < 0)
+			panic("%s: bprintf: %e", what, r);
+	if ((r = fclose(f)) < 0)
+		panic("%s: fclose: %e", what, r);
+}
+
+static void
+read_lines(const char *what, FILE *f)
+{
+	char line[64], want[64];
+	int i;
+
+	for (i = 0; i < NLINES; i++) {
+		snprintf(want, sizeof want, "line %d of %d\n", i, NLINES);
+		if (!fgets(line, sizeof line, f))
+			panic("%s: short read at line %d", what, i);
+		if (strcmp(line, want) != 0)
+			panic("%s: line %d is '%s'", what, i, line);
+	}
+	if (fgetc(f) != -E_EOF || !feof(f))
+		panic("%s: no end of file", what);
+	fclose(f);
+	cprintf("%s ok\n", what);
+}
+
+void
+umain(int argc, char **argv)
+{
+	FILE *f;
+	int fd, p[2], pid;
+
+	// Through a pipe, with the reader in a child
+	if ((fd = pipe(p)) < 0)
+		panic("pipe: %e", fd);
+	if ((pid = fork()) < 0)
+		panic("fork: %e", pid);
+	if (pid == 0) {
+		close(p[1]);
+		if (!(f = fdopen(p[0], "r")))
+			panic("fdopen");
+		read_lines("pipe", f);
+		exit();
+	}
+	close(p[0]);
+	if (!(f = fdopen(p[1], "w")))
+		panic("fdopen");
+	write_lines("pipe", f);
+	wait(pid);
+
+	// Through a file
+	if ((fd = open("/teststdio", O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+		panic("open /teststdio: %e", fd);
+	if (!(f = fdopen(fd, "w")))
+		panic("fdopen");
+	write_lines("file", f);
+	if ((fd = open("/teststdio", O_RDONLY)) < 0)
+		panic("open /teststdio: %e", fd);
+	if (!(f = fdopen(fd, "r")))
+		panic("fdopen");
+	read_lines("file", f);
+
+	cprintf("stdio tests passed\n");
+}
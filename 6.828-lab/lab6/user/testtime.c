@@ -16,6 +16,27 @@ sleep(int sec)
 		sys_yield();
 }
 
+// time_usec never goes backwards and agrees with sys_time_msec.
+void
+check_clock(void)
+{
+	uint64_t usec, last = 0;
+	unsigned msec;
+	int i;
+
+	for (i = 0; i < 200; i++) {
+		msec = sys_time_msec();
+		usec = time_usec();
+		if (usec < last)
+			panic("time_usec went backwards");
+		if (usec / 1000 < msec || usec / 1000 > sys_time_msec())
+			panic("time_usec %u ms, sys_time_msec %u ms",
+			      (unsigned) (usec / 1000), msec);
+		last = usec;
+		sys_yield();
+	}
+}
+
 void
 umain(int argc, char **argv)
 {
@@ -25,6 +46,8 @@ umain(int argc, char **argv)
 	for (i = 0; i < 50; i++)
 		sys_yield();
 
+	check_clock();
+
 	cprintf("starting count down: ");
 	for (i = 5; i >= 0; i--) {
 		cprintf("%d ", i);